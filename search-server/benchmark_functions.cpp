@@ -0,0 +1,967 @@
+#include "benchmark_functions.h"
+#include "concurrent_map.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <set>
+#include <thread>
+#include <unordered_map>
+
+using namespace std;
+
+namespace {
+
+// The previous ConcurrentMap design: a mutex and a std::map per bucket
+template <typename Key, typename Value>
+class MapBucketConcurrentMap {
+public:
+    explicit MapBucketConcurrentMap(size_t bucket_count)
+        : buckets_(bucket_count) {
+    }
+
+    void FetchAdd(const Key& key, Value delta) {
+        auto& bucket = buckets_[static_cast<uint64_t>(key) % buckets_.size()];
+        lock_guard guard(bucket.mutex);
+        bucket.map[key] += delta;
+    }
+
+private:
+    struct Bucket {
+        std::mutex mutex;
+        std::map<Key, Value> map;
+    };
+
+    vector<Bucket> buckets_;
+};
+
+// The previous ProcessQueries: every query parsed and scored on its own,
+// chunks of them split evenly between the cores
+vector<vector<Document>> ProcessQueriesIndependently(const SearchServer& search_server, const vector<string>& queries) {
+    vector<vector<Document>> result(queries.size());
+    transform(execution::par, queries.begin(), queries.end(), result.begin(), [&search_server](const string& query) {
+        return search_server.FindTopDocuments(query);
+    });
+    return result;
+}
+
+// The previous ProcessQueriesJoined: a list node per document, copied
+// from per-query vectors
+list<Document> ProcessQueriesJoinedAsList(const SearchServer& search_server, const vector<string>& queries) {
+    list<Document> result;
+    for (auto step : ProcessQueries(search_server, queries)) {
+        for (auto document : step) {
+            result.push_back(document);
+        }
+    }
+    return result;
+}
+
+// The previous RemoveDuplicates, minus the removal and printing: a set of
+// word strings per document, looked up in a set of such sets
+vector<int> FindDuplicatesWithWordSets(const SearchServer& search_server) {
+    set<set<string>> word_sets;
+    vector<int> duplicates;
+    for (const int document_id : search_server) {
+        set<string> words;
+        for (const auto& [word, freq] : search_server.GetWordFrequencies(document_id)) {
+            words.insert(string(word));
+        }
+        if (!word_sets.insert(move(words)).second) {
+            duplicates.push_back(document_id);
+        }
+    }
+    return duplicates;
+}
+
+// The previous tokenizer: a find(' ') loop, then a second pass over each word
+// for control characters
+bool SplitAndValidateWithFind(string_view text, vector<string_view>& words) {
+    words.clear();
+    for (size_t first = 0; first <= text.size();) {
+        const size_t last = min(text.find(' ', first), text.size());
+        words.push_back(text.substr(first, last - first));
+        first = last + 1;
+    }
+    return all_of(words.begin(), words.end(), [](string_view word) {
+        return none_of(word.begin(), word.end(), [](char c) { return c >= '\0' && c < ' '; });
+    });
+}
+
+template <typename Map>
+double MeasureFetchAdd(Map& concurrent_map, int thread_count, int operation_count, int key_count) {
+    const auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&concurrent_map, t, thread_count, operation_count, key_count] {
+            mt19937 generator(t);
+            uniform_int_distribution<int> key(0, key_count - 1);
+            for (int i = t; i < operation_count; i += thread_count) {
+                concurrent_map.FetchAdd(key(generator), 1.0);
+            }
+        });
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Generated words and documents of one benchmark
+struct BenchmarkCorpus {
+    vector<string> dictionary;
+    vector<string> texts;
+
+    // The documents are generated with seed + 1
+    BenchmarkCorpus(int word_count, int document_count, int max_word_count, unsigned seed, int max_word_length = 10)
+        : dictionary(GenerateDictionary(word_count, max_word_length, seed))
+        , texts(GenerateDocuments(dictionary, document_count, max_word_count, seed + 1))
+    {
+    }
+
+    // Text i gets id i, ACTUAL status and a rating of i % 10
+    vector<NewDocument> MakeDocuments() const {
+        vector<NewDocument> documents(texts.size());
+        for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+            documents[id] = { id, texts[id], DocumentStatus::ACTUAL, { id % 10 } };
+        }
+        return documents;
+    }
+};
+
+// A query word drawn from the first max_rank + 1 words of the dictionary,
+// which documents use the most
+struct QueryWordSpec {
+    size_t max_rank;
+    bool is_minus = false;
+};
+
+vector<string> GenerateQueries(const vector<string>& dictionary, int query_count, const vector<QueryWordSpec>& words, unsigned seed) {
+    mt19937 generator(seed);
+    vector<string> queries(query_count);
+    for (string& query : queries) {
+        for (const QueryWordSpec& word : words) {
+            if (!query.empty()) {
+                query.push_back(' ');
+            }
+            if (word.is_minus) {
+                query.push_back('-');
+            }
+            query += dictionary[uniform_int_distribution<size_t>(0, word.max_rank)(generator)];
+        }
+    }
+    return queries;
+}
+
+template <typename Find>
+vector<vector<Document>> FindForEach(const vector<string>& queries, Find find) {
+    vector<vector<Document>> results;
+    results.reserve(queries.size());
+    for (const string& query : queries) {
+        results.push_back(find(query));
+    }
+    return results;
+}
+
+// Same ids, ratings and order, with relevances at most tolerance apart
+bool SameDocuments(const vector<Document>& lhs, const vector<Document>& rhs, double tolerance = 0.0) {
+    return lhs.size() == rhs.size() && equal(lhs.begin(), lhs.end(), rhs.begin(), [tolerance](const Document& l, const Document& r) {
+        return l.id == r.id && l.rating == r.rating && abs(l.relevance - r.relevance) <= tolerance;
+    });
+}
+
+int CountMismatches(const vector<vector<Document>>& expected, const vector<vector<Document>>& actual, double tolerance = 0.0) {
+    int mismatch_count = expected.size() == actual.size() ? 0 : 1;
+    for (size_t i = 0; i < min(expected.size(), actual.size()); ++i) {
+        mismatch_count += SameDocuments(expected[i], actual[i], tolerance) ? 0 : 1;
+    }
+    return mismatch_count;
+}
+
+double SecondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+}
+
+vector<string> GenerateDictionary(int word_count, int max_length, unsigned seed) {
+    mt19937 generator(seed);
+    vector<string> words;
+    words.reserve(word_count);
+    for (int i = 0; i < word_count; ++i) {
+        const int length = uniform_int_distribution(2, max_length)(generator);
+        string word(length, ' ');
+        for (char& c : word) {
+            c = static_cast<char>(uniform_int_distribution<int>('a', 'z')(generator));
+        }
+        words.push_back(move(word));
+    }
+    return words;
+}
+
+vector<string> GenerateDocuments(const vector<string>& dictionary, int document_count, int max_word_count, unsigned seed) {
+    mt19937 generator(seed);
+    // Skewed towards the beginning of the dictionary, like real word frequencies
+    uniform_real_distribution<double> position(0.0, 1.0);
+    vector<string> documents;
+    documents.reserve(document_count);
+    for (int i = 0; i < document_count; ++i) {
+        const int word_count = uniform_int_distribution(1, max_word_count)(generator);
+        string document;
+        for (int j = 0; j < word_count; ++j) {
+            if (j > 0) {
+                document.push_back(' ');
+            }
+            const double x = position(generator);
+            document += dictionary[static_cast<size_t>(x * x * x * (dictionary.size() - 1))];
+        }
+        documents.push_back(move(document));
+    }
+    return documents;
+}
+
+
+void BenchmarkTextStorage(int document_count) {
+    BenchmarkCorpus corpus(20000, document_count, 100, 1, 12);
+
+    size_t caller_bytes = 0;
+    for (const string& document : corpus.texts) {
+        caller_bytes += sizeof(string) + document.capacity();
+    }
+
+    SearchServer search_server(""s);
+    for (int id = 0; id < document_count; ++id) {
+        search_server.AddDocument(id, corpus.texts[id], DocumentStatus::ACTUAL, { 1 });
+    }
+    // The server no longer points into these buffers
+    corpus.texts.clear();
+    corpus.texts.shrink_to_fit();
+
+    const size_t server_bytes = search_server.GetTextStorageBytes();
+    cout << "Text storage for "s << document_count << " documents:"s << endl;
+    cout << "  before (caller keeps documents alive): "s
+        << static_cast<double>(caller_bytes + server_bytes) / document_count << " bytes/doc"s << endl;
+    cout << "  after (server-owned arena only): "s
+        << static_cast<double>(server_bytes) / document_count << " bytes/doc"s << endl;
+}
+
+void BenchmarkPostingDecode(int posting_count, int repeat_count) {
+    mt19937 generator(3);
+    vector<int> document_ids;
+    vector<double> term_freqs;
+    PostingList posting_list;
+    int document_id = 0;
+    for (int i = 0; i < posting_count; ++i) {
+        document_id += uniform_int_distribution(1, 8)(generator);
+        const uint32_t term_count = uniform_int_distribution(1, 3)(generator);
+        document_ids.push_back(document_id);
+        term_freqs.push_back(term_count / 20.0);
+        posting_list.Add(document_id, term_count);
+    }
+
+    using Clock = chrono::steady_clock;
+    const auto report = [posting_count, repeat_count](const string& name, Clock::duration duration, size_t bytes, double checksum) {
+        const double seconds = chrono::duration<double>(duration).count();
+        cout << "  "s << name << ": "s << static_cast<double>(bytes) / posting_count << " bytes/posting, "s
+            << posting_count * static_cast<double>(repeat_count) / seconds / 1e6 << " M postings/s"s
+            << " (checksum "s << checksum << ")"s << endl;
+    };
+
+    cout << "Posting decode, "s << posting_count << " postings:"s << endl;
+    {
+        double sum = 0.0;
+        const auto start = Clock::now();
+        for (int r = 0; r < repeat_count; ++r) {
+            for (size_t i = 0; i < document_ids.size(); ++i) {
+                sum += document_ids[i] * term_freqs[i];
+            }
+        }
+        report("uncompressed"s, Clock::now() - start,
+            document_ids.capacity() * sizeof(int) + term_freqs.capacity() * sizeof(double), sum);
+    }
+    {
+        double sum = 0.0;
+        const auto start = Clock::now();
+        for (int r = 0; r < repeat_count; ++r) {
+            posting_list.ForEach([&sum](int document_id, uint32_t term_count) {
+                sum += document_id * (term_count / 20.0);
+            });
+        }
+        report("compressed"s, Clock::now() - start, posting_list.GetMemoryUsage(), sum);
+    }
+}
+
+void BenchmarkParallelScoring(int document_count, int query_count, int query_word_count) {
+    const BenchmarkCorpus corpus(50000, document_count, 50, 7);
+    SearchServer search_server(""s);
+    search_server.AddDocuments(corpus.MakeDocuments());
+    // Frequent words, so that every query touches a large part of the index
+    const auto queries = GenerateQueries(corpus.dictionary, query_count, vector<QueryWordSpec>(query_word_count, { 50 }), 9);
+
+    vector<vector<Document>> sequential_results;
+    vector<vector<Document>> parallel_results;
+    cout << "Broad queries of "s << query_word_count << " words over "s << document_count << " documents, "s
+        << thread::hardware_concurrency() << " threads:"s << endl;
+    auto start = chrono::steady_clock::now();
+    sequential_results = FindForEach(queries, [&](const string& query) {
+        return search_server.FindTopDocuments(execution::seq, query);
+    });
+    cout << "  seq: "s << SecondsSince(start) * 1000 / query_count << " ms/query"s << endl;
+    start = chrono::steady_clock::now();
+    parallel_results = FindForEach(queries, [&](const string& query) {
+        return search_server.FindTopDocuments(execution::par, query);
+    });
+    cout << "  par: "s << SecondsSince(start) * 1000 / query_count << " ms/query"s << endl;
+    cout << "  mismatched results: "s << CountMismatches(sequential_results, parallel_results) << endl;
+}
+
+void BenchmarkConcurrentMap(int operation_count, int key_count) {
+    cout << "Concurrent FetchAdd, "s << operation_count << " operations over "s << key_count << " keys:"s << endl;
+    for (int thread_count = 1; thread_count <= 64; thread_count *= 2) {
+        const size_t bucket_count = max(1u, thread::hardware_concurrency()) * 8;
+        MapBucketConcurrentMap<int, double> map_buckets(bucket_count);
+        ConcurrentMap<int, double> open_addressing(bucket_count);
+        const double map_seconds = MeasureFetchAdd(map_buckets, thread_count, operation_count, key_count);
+        const double open_seconds = MeasureFetchAdd(open_addressing, thread_count, operation_count, key_count);
+        cout << "  "s << thread_count << " threads: map buckets "s << operation_count / map_seconds / 1e6
+            << " M ops/s, open addressing "s << operation_count / open_seconds / 1e6 << " M ops/s"s << endl;
+    }
+}
+
+void BenchmarkMixedLoad(int document_count, int reader_count, int write_count) {
+    const BenchmarkCorpus corpus(20000, document_count + write_count, 30, 10);
+    ConcurrentSearchServer search_server(""s);
+    for (int id = 0; id < document_count; ++id) {
+        search_server.AddDocument(id, corpus.texts[id], DocumentStatus::ACTUAL, { id % 10 });
+    }
+    const auto queries = GenerateQueries(corpus.dictionary, 1000, { { 500 }, { 5000 } }, 12);
+
+    atomic_bool writing = true;
+    atomic_int violation_count = 0;
+    vector<vector<double>> latencies(reader_count);
+    vector<thread> readers;
+    for (int r = 0; r < reader_count; ++r) {
+        readers.emplace_back([&, r] {
+            for (size_t i = r; writing; i += reader_count) {
+                const string& query = queries[i % queries.size()];
+                const auto start = chrono::steady_clock::now();
+                const auto snapshot = search_server.GetSnapshot();
+                const auto result = snapshot->FindTopDocuments(query);
+                latencies[r].push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+                if (snapshot->GetDocumentCount() != distance(snapshot->begin(), snapshot->end())) {
+                    ++violation_count;
+                }
+                for (const Document& document : result) {
+                    if (get<0>(snapshot->MatchDocument(query, document.id)).empty()) {
+                        ++violation_count;
+                    }
+                }
+            }
+        });
+    }
+
+    // Every step adds a new document and removes the oldest one still present
+    const auto write_start = chrono::steady_clock::now();
+    for (int i = 0; i < write_count; ++i) {
+        const int id = document_count + i;
+        search_server.AddDocument(id, corpus.texts[id], DocumentStatus::ACTUAL, { id % 10 });
+        search_server.RemoveDocument(i);
+    }
+    const double write_seconds = SecondsSince(write_start);
+    writing = false;
+    for (thread& reader : readers) {
+        reader.join();
+    }
+
+    SearchServer expected_server(""s);
+    for (int id = write_count; id < document_count + write_count; ++id) {
+        expected_server.AddDocument(id, corpus.texts[id], DocumentStatus::ACTUAL, { id % 10 });
+    }
+    violation_count += CountMismatches(
+        FindForEach(queries, [&](const string& query) { return expected_server.FindTopDocuments(query); }),
+        FindForEach(queries, [&](const string& query) { return search_server.FindTopDocuments(query); }), EPSILON);
+
+    vector<double> all_latencies;
+    for (const auto& reader_latencies : latencies) {
+        all_latencies.insert(all_latencies.end(), reader_latencies.begin(), reader_latencies.end());
+    }
+    sort(all_latencies.begin(), all_latencies.end());
+    const auto percentile = [&all_latencies](double p) {
+        return all_latencies.empty() ? 0.0 : all_latencies[static_cast<size_t>(p * (all_latencies.size() - 1))];
+    };
+    cout << "Mixed load, "s << reader_count << " readers, "s << write_count << " add+remove pairs over "s
+        << document_count << " documents:"s << endl;
+    cout << "  writes: "s << write_count / write_seconds << " pairs/s"s << endl;
+    cout << "  queries: "s << all_latencies.size() << ", p50 "s << percentile(0.5) << " ms, p99 "s
+        << percentile(0.99) << " ms"s << endl;
+    cout << "  violations: "s << violation_count << endl;
+}
+
+void BenchmarkSegmentedIngest(int document_count, int query_count) {
+    const BenchmarkCorpus corpus(50000, document_count, 50, 13);
+    const auto queries = GenerateQueries(corpus.dictionary, query_count, { { 1000 }, { 10000 }, { 2000, true } }, 15);
+
+    cout << "Bulk load of "s << document_count << " documents:"s << endl;
+    SearchServer search_server(""s);
+    auto start = chrono::steady_clock::now();
+    for (int id = 0; id < document_count; ++id) {
+        search_server.AddDocument(id, corpus.texts[id], DocumentStatus::ACTUAL, { id % 10 });
+    }
+    cout << "  single index: "s << document_count / SecondsSince(start) << " docs/s"s << endl;
+
+    SegmentedSearchServer segmented_server(""s);
+    start = chrono::steady_clock::now();
+    for (int id = 0; id < document_count; ++id) {
+        segmented_server.AddDocument(id, corpus.texts[id], DocumentStatus::ACTUAL, { id % 10 });
+    }
+    const double ingest_seconds = SecondsSince(start);
+    segmented_server.Flush();
+    segmented_server.WaitForMerges();
+    cout << "  segmented: "s << document_count / ingest_seconds << " docs/s, "s
+        << document_count / SecondsSince(start) << " docs/s including merges, "s
+        << segmented_server.GetSegmentCount() << " segments"s << endl;
+
+    const auto find_all = [&queries](const auto& server) {
+        return FindForEach(queries, [&server](const string& query) { return server.FindTopDocuments(query); });
+    };
+    cout << "  mismatched results: "s << CountMismatches(find_all(search_server), find_all(segmented_server), EPSILON) << endl;
+
+    for (int id = 0; id < document_count; id += 3) {
+        segmented_server.RemoveDocument(id);
+    }
+    int removed_found = 0;
+    for (const string& query : queries) {
+        for (const Document& document : segmented_server.FindTopDocuments(query, DocumentStatus::ACTUAL, 100)) {
+            removed_found += document.id % 3 == 0;
+        }
+    }
+    segmented_server.WaitForMerges();
+    cout << "  after removing every third document: "s << segmented_server.GetDocumentCount() << " documents, "s
+        << removed_found << " removed ones returned"s << endl;
+}
+
+void BenchmarkBulkBuild(int document_count, int query_count) {
+    const BenchmarkCorpus corpus(50000, document_count, 50, 16);
+    const auto documents = corpus.MakeDocuments();
+    const auto queries = GenerateQueries(corpus.dictionary, query_count, { { 1000 }, { 10000 }, { 2000, true } }, 18);
+
+    cout << "Cold build of "s << document_count << " documents on "s << thread::hardware_concurrency() << " cores:"s << endl;
+    SearchServer expected_server(""s);
+    auto start = chrono::steady_clock::now();
+    for (const NewDocument& document : documents) {
+        expected_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    cout << "  AddDocument loop: "s << SecondsSince(start) << " s"s << endl;
+
+    SearchServer sequential_server(""s);
+    start = chrono::steady_clock::now();
+    sequential_server.AddDocuments(execution::seq, documents);
+    cout << "  AddDocuments(seq): "s << SecondsSince(start) << " s"s << endl;
+
+    SearchServer parallel_server(""s);
+    start = chrono::steady_clock::now();
+    parallel_server.AddDocuments(execution::par, documents);
+    cout << "  AddDocuments(par): "s << SecondsSince(start) << " s"s << endl;
+
+    const auto find_all = [&queries](const SearchServer& server) {
+        return FindForEach(queries, [&server](const string& query) { return server.FindTopDocuments(query); });
+    };
+    const auto expected = find_all(expected_server);
+    cout << "  mismatched results: "s
+        << CountMismatches(expected, find_all(sequential_server)) + CountMismatches(expected, find_all(parallel_server)) << endl;
+}
+
+void BenchmarkIndexFile(int document_count, int query_count, const string& path) {
+    const BenchmarkCorpus corpus(50000, document_count, 50, 19);
+    auto documents = corpus.MakeDocuments();
+    for (NewDocument& document : documents) {
+        document.status = static_cast<DocumentStatus>(document.id % 4);
+        document.ratings.push_back(document.id % 7);
+    }
+    const auto queries = GenerateQueries(corpus.dictionary, query_count, { { 1000 }, { 10000 }, { 2000, true } }, 21);
+
+    SearchServer original("and in on the"s);
+    original.AddDocuments(documents);
+    for (int id = 0; id < document_count; id += 5) {
+        original.RemoveDocument(id);
+    }
+
+    auto start = chrono::steady_clock::now();
+    original.Save(path);
+    cout << "Index file of "s << original.GetDocumentCount() << " documents:"s << endl;
+    cout << "  save: "s << SecondsSince(start) << " s, "s << filesystem::file_size(path) / (1 << 20) << " MB"s << endl;
+
+    start = chrono::steady_clock::now();
+    const SearchServer opened = SearchServer::Open(path);
+    cout << "  open: "s << SecondsSince(start) << " s"s << endl;
+    start = chrono::steady_clock::now();
+    opened.FindTopDocuments(queries.front());
+    cout << "  first query: "s << SecondsSince(start) << " s"s << endl;
+    start = chrono::steady_clock::now();
+    SearchServer::Open(path, true);
+    cout << "  open with verification: "s << SecondsSince(start) << " s"s << endl;
+
+    int mismatch_count = opened.GetDocumentCount() == original.GetDocumentCount() ? 0 : 1;
+    for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+        const auto find_all = [&queries, status](const SearchServer& server) {
+            return FindForEach(queries, [&server, status](const string& query) { return server.FindTopDocuments(query, status); });
+        };
+        mismatch_count += CountMismatches(find_all(original), find_all(opened));
+    }
+    for (const string& query : queries) {
+        const int document_id = 1 + static_cast<int>(query.size()) % (document_count - 1);
+        if (document_id % 5 != 0 && original.MatchDocument(query, document_id) != opened.MatchDocument(query, document_id)) {
+            ++mismatch_count;
+        }
+    }
+    cout << "  mismatched results: "s << mismatch_count << endl;
+}
+
+void BenchmarkCorpusLoad(int document_count, int query_count, const string& path) {
+    static const string STATUS_NAMES[] = { "ACTUAL"s, "IRRELEVANT"s, "BANNED"s, "REMOVED"s };
+    const BenchmarkCorpus corpus(50000, document_count, 50, 22);
+    auto documents = corpus.MakeDocuments();
+    {
+        ofstream out(path, ios::binary);
+        for (NewDocument& document : documents) {
+            const int id = document.id;
+            document.status = static_cast<DocumentStatus>(id % 4);
+            document.ratings.push_back(-(id % 3));
+            out << id << '\t' << STATUS_NAMES[id % 4] << '\t' << id % 10 << ' ' << -(id % 3) << '\t' << document.text << '\n';
+        }
+    }
+    const auto queries = GenerateQueries(corpus.dictionary, query_count, { { 1000 }, { 10000 } }, 24);
+
+    SearchServer loaded_server(""s);
+    cout << "LoadCorpus: "s << LoadCorpus(loaded_server, path) << endl;
+    SearchServer expected_server(""s);
+    expected_server.AddDocuments(execution::par, documents);
+
+    int mismatch_count = loaded_server.GetDocumentCount() == expected_server.GetDocumentCount() ? 0 : 1;
+    for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+        const auto find_all = [&queries, status](const SearchServer& server) {
+            return FindForEach(queries, [&server, status](const string& query) { return server.FindTopDocuments(query, status); });
+        };
+        mismatch_count += CountMismatches(find_all(expected_server), find_all(loaded_server));
+    }
+    cout << "  mismatched results: "s << mismatch_count << endl;
+}
+
+void BenchmarkTokenizer(int document_count, int repeat_count) {
+    const BenchmarkCorpus corpus(50000, document_count, 50, 25);
+    size_t byte_count = 0;
+    for (const string& text : corpus.texts) {
+        byte_count += text.size();
+    }
+    const auto measure = [&](const auto& split) {
+        vector<string_view> words;
+        size_t word_count = 0;
+        const auto start = chrono::steady_clock::now();
+        for (int i = 0; i < repeat_count; ++i) {
+            for (const string& text : corpus.texts) {
+                split(text, words);
+                word_count += words.size();
+            }
+        }
+        cout << byte_count * repeat_count / SecondsSince(start) / 1e9 << " GB/s, "s << word_count << " words"s << endl;
+    };
+    cout << "Tokenizing "s << byte_count / (1 << 20) << " MB"s << endl;
+    cout << "  find(' ') and validation: "s;
+    measure(SplitAndValidateWithFind);
+    cout << "  SplitIntoWords: "s;
+    measure([](string_view text, vector<string_view>& words) { return SplitIntoWords(text, words); });
+}
+
+void BenchmarkInvalidQueries(int document_count, int query_count) {
+    const BenchmarkCorpus corpus(20000, document_count, 30, 27);
+    SearchServer search_server(""s);
+    search_server.AddDocuments(corpus.MakeDocuments());
+    // Every query has one rejected word after two valid ones
+    auto queries = GenerateQueries(corpus.dictionary, query_count, { { 19999 }, { 19999 } }, 29);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        queries[i] += i % 2 == 0 ? " --"s : " -"s;
+    }
+
+    cout << "Rejecting "s << query_count << " invalid queries:"s << endl;
+    int rejected_count = 0;
+    {
+        LOG_DURATION_STREAM("  FindTopDocuments with exceptions"s);
+        for (const string& query : queries) {
+            try {
+                search_server.FindTopDocuments(query);
+            }
+            catch (const invalid_argument&) {
+                ++rejected_count;
+            }
+        }
+    }
+    vector<Document> result;
+    {
+        LOG_DURATION_STREAM("  TryFindTopDocuments"s);
+        for (const string& query : queries) {
+            if (search_server.TryFindTopDocuments(query, DocumentStatus::ACTUAL, result) != QueryError::NONE) {
+                ++rejected_count;
+            }
+        }
+    }
+    cout << "  rejected: "s << rejected_count << " of "s << 2 * query_count << endl;
+}
+
+void BenchmarkQueryCache(int document_count, int query_count, int distinct_query_count) {
+    const BenchmarkCorpus corpus(20000, document_count, 30, 30);
+    SearchServer search_server(""s);
+    search_server.AddDocuments(corpus.MakeDocuments());
+    const auto distinct_queries = GenerateQueries(corpus.dictionary, distinct_query_count,
+        { { 2000 }, { 2000 }, { 2000, true } }, 32);
+    // Zipf-like popularity: query i is asked about 1 / (i + 1) as often as the first one
+    vector<double> weights(distinct_query_count);
+    for (int i = 0; i < distinct_query_count; ++i) {
+        weights[i] = 1.0 / (i + 1);
+    }
+    mt19937 generator(33);
+    discrete_distribution<int> popularity(weights.begin(), weights.end());
+    vector<string> queries;
+    for (int i = 0; i < query_count; ++i) {
+        queries.push_back(distinct_queries[popularity(generator)]);
+    }
+
+    cout << query_count << " queries, "s << distinct_query_count << " distinct:"s << endl;
+    vector<vector<Document>> expected;
+    {
+        LOG_DURATION_STREAM("  ProcessQueries"s);
+        expected = ProcessQueries(search_server, queries);
+    }
+    QueryCache query_cache(search_server);
+    vector<vector<Document>> actual;
+    {
+        LOG_DURATION_STREAM("  ProcessQueries with QueryCache"s);
+        actual = ProcessQueries(query_cache, queries);
+    }
+    int mismatch_count = CountMismatches(expected, actual);
+    cout << "  hits: "s << query_cache.GetHitCount() << ", misses: "s << query_cache.GetMissCount()
+        << ", memory: "s << query_cache.GetMemoryUsage() / 1024 << " KB"s << endl;
+
+    // A change to the index has to invalidate every cached result
+    search_server.AddDocument(document_count, distinct_queries.front(), DocumentStatus::ACTUAL, { 100 });
+    mismatch_count += SameDocuments(search_server.FindTopDocuments(distinct_queries.front()),
+        query_cache.FindTopDocuments(distinct_queries.front())) ? 0 : 1;
+    cout << "  mismatched results: "s << mismatch_count << endl;
+}
+
+void BenchmarkPostingIntersection(int document_count, int query_count) {
+    mt19937 generator(33);
+    const auto random_ids = [&generator](int count, int range) {
+        vector<int> ids(count);
+        for (int& id : ids) {
+            id = uniform_int_distribution(0, range - 1)(generator);
+        }
+        sort(ids.begin(), ids.end());
+        ids.erase(unique(ids.begin(), ids.end()), ids.end());
+        return ids;
+    };
+    using Kernel = size_t (*)(const int*, size_t, const int*, size_t, int*);
+    const auto measure = [](const string& name, Kernel kernel, const vector<int>& a, const vector<int>& b, vector<int>& out) {
+        out.resize(a.size());
+        LOG_DURATION_STREAM("    "s + name);
+        for (int r = 0; r < 20; ++r) {
+            out.resize(kernel(a.data(), a.size(), b.data(), b.size(), out.data()));
+        }
+    };
+    cout << "Sorted id kernels, 20 runs each:"s << endl;
+    int kernel_mismatch_count = 0;
+    for (const auto& [a_count, b_count] : { pair{ 1000000, 1000000 }, pair{ 2000, 1000000 } }) {
+        const vector<int> a = random_ids(a_count, 4000000);
+        const vector<int> b = random_ids(b_count, 4000000);
+        cout << "  "s << a.size() << " and "s << b.size() << " ids:"s << endl;
+        vector<int> expected;
+        vector<int> actual;
+        measure("intersect, merge"s, IntersectSortedIdsScalar, a, b, expected);
+        measure("intersect"s, IntersectSortedIds, a, b, actual);
+        kernel_mismatch_count += expected == actual ? 0 : 1;
+        measure("subtract, merge"s, SubtractSortedIdsScalar, a, b, expected);
+        measure("subtract"s, SubtractSortedIds, a, b, actual);
+        kernel_mismatch_count += expected == actual ? 0 : 1;
+    }
+    cout << "  mismatched results: "s << kernel_mismatch_count << endl;
+
+    const BenchmarkCorpus corpus(20000, document_count, 30, 34);
+    SearchServer search_server(""s);
+    search_server.AddDocuments(corpus.MakeDocuments());
+    const auto queries = GenerateQueries(corpus.dictionary, query_count, { { 1000 }, { 1000 }, { 1000 }, { 100, true } }, 36);
+
+    cout << query_count << " queries of 3 plus words and a minus word over "s << document_count << " documents:"s << endl;
+    {
+        LOG_DURATION_STREAM("  FindTopDocuments, any word"s);
+        for (const string& query : queries) {
+            search_server.FindTopDocuments(query);
+        }
+    }
+    vector<vector<Document>> results;
+    {
+        LOG_DURATION_STREAM("  FindTopDocumentsWithAllWords"s);
+        results = FindForEach(queries, [&](const string& query) { return search_server.FindTopDocumentsWithAllWords(query); });
+    }
+    // Expected: the documents with any word, in order, keeping those that have all of them
+    const auto expected = FindForEach(queries, [&](const string& query) {
+        const auto words = SplitIntoWords(query);
+        vector<Document> documents;
+        for (const Document& document : search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, document_count)) {
+            const auto word_freqs = search_server.GetWordFrequencies(document.id);
+            const bool has_all = all_of(words.begin(), words.end(), [&word_freqs](string_view word) {
+                return word[0] == '-' || word_freqs.count(word) > 0;
+            });
+            if (has_all && documents.size() < MAX_RESULT_DOCUMENT_COUNT) {
+                documents.push_back(document);
+            }
+        }
+        return documents;
+    });
+    cout << "  mismatched results: "s << CountMismatches(expected, results) << endl;
+}
+
+void BenchmarkQueryBatch(int document_count, int query_count) {
+    const BenchmarkCorpus corpus(20000, document_count, 30, 36);
+    const auto& dictionary = corpus.dictionary;
+    SearchServer search_server(""s);
+    search_server.AddDocuments(corpus.MakeDocuments());
+    // Mostly cheap queries of rarer words, every tenth a heavy one of the
+    // most frequent words, and a third of them repeats of earlier ones
+    mt19937 generator(38);
+    vector<string> queries;
+    for (int i = 0; i < query_count; ++i) {
+        if (i > 0 && uniform_int_distribution(0, 2)(generator) == 0) {
+            queries.push_back(queries[uniform_int_distribution(0, i - 1)(generator)]);
+            continue;
+        }
+        const bool heavy = i % 10 == 0;
+        const size_t first_word = heavy ? 0 : 500;
+        const size_t last_word = heavy ? 50 : dictionary.size() - 1;
+        string query;
+        for (int j = 0; j < (heavy ? 6 : 3); ++j) {
+            query += dictionary[uniform_int_distribution(first_word, last_word)(generator)] + " "s;
+        }
+        query += "-"s + dictionary[uniform_int_distribution<size_t>(500, 5000)(generator)];
+        queries.push_back(move(query));
+    }
+
+    cout << query_count << " queries over "s << document_count << " documents:"s << endl;
+    vector<vector<Document>> expected;
+    {
+        LOG_DURATION_STREAM("  independent queries"s);
+        expected = ProcessQueriesIndependently(search_server, queries);
+    }
+    QueryBatchStatistics statistics;
+    vector<vector<Document>> actual;
+    {
+        LOG_DURATION_STREAM("  QueryBatch"s);
+        actual = ProcessQueries(search_server, queries, statistics);
+    }
+    cout << "  "s << statistics << endl;
+    cout << "  mismatched results: "s << CountMismatches(expected, actual) << endl;
+}
+
+void BenchmarkJoinedResults(int document_count, int query_count) {
+    const BenchmarkCorpus corpus(20000, document_count, 30, 39);
+    SearchServer search_server(""s);
+    search_server.AddDocuments(corpus.MakeDocuments());
+    const auto queries = GenerateQueries(corpus.dictionary, query_count, { { 3000 }, { 3000 } }, 41);
+
+    cout << "Joined results of "s << query_count << " queries:"s << endl;
+    list<Document> expected;
+    {
+        LOG_DURATION_STREAM("  std::list"s);
+        expected = ProcessQueriesJoinedAsList(search_server, queries);
+    }
+    JoinedDocuments actual;
+    {
+        LOG_DURATION_STREAM("  JoinedDocuments"s);
+        actual = ProcessQueriesJoined(search_server, queries);
+    }
+    // A list node holds two pointers besides the document
+    cout << "  "s << expected.size() << " documents, std::list "s
+        << expected.size() * (sizeof(Document) + 2 * sizeof(void*)) / 1024 << " KB, JoinedDocuments "s
+        << (actual.size() * sizeof(Document) + (actual.GetQueryCount() + 1) * sizeof(size_t)) / 1024 << " KB"s << endl;
+    size_t per_query_count = 0;
+    for (size_t i = 0; i < actual.GetQueryCount(); ++i) {
+        per_query_count += actual.GetQueryDocuments(i).size();
+    }
+    const bool same = per_query_count == actual.size()
+        && SameDocuments(vector<Document>(expected.begin(), expected.end()), vector<Document>(actual.begin(), actual.end()));
+    cout << "  same results: "s << (same ? "yes"s : "no"s) << endl;
+}
+
+void BenchmarkShardedSearch(int document_count, int query_count, int shard_count) {
+    const BenchmarkCorpus corpus(20000, document_count, 30, 42);
+    auto documents = corpus.MakeDocuments();
+    for (NewDocument& document : documents) {
+        if (document.id % 7 == 0) {
+            document.status = DocumentStatus::BANNED;
+        }
+    }
+    const auto queries = GenerateQueries(corpus.dictionary, query_count, { { 3000 }, { 3000 }, { 3000, true } }, 44);
+
+    cout << document_count << " documents, "s << shard_count << " shards:"s << endl;
+    SearchServer search_server(""s);
+    {
+        LOG_DURATION_STREAM("  SearchServer build"s);
+        search_server.AddDocuments(documents);
+    }
+    ShardedSearchServer sharded_server(""sv, shard_count);
+    {
+        LOG_DURATION_STREAM("  ShardedSearchServer build"s);
+        sharded_server.AddDocuments(documents);
+    }
+    // Removals change the document counts, and so the scores, of every shard
+    for (int id = 0; id < document_count; id += 5) {
+        search_server.RemoveDocument(id);
+        sharded_server.RemoveDocument(id);
+    }
+
+    vector<vector<Document>> expected;
+    vector<vector<Document>> actual;
+    {
+        LOG_DURATION_STREAM("  SearchServer queries"s);
+        expected = FindForEach(queries, [&](const string& query) { return search_server.FindTopDocuments(query); });
+    }
+    {
+        LOG_DURATION_STREAM("  ShardedSearchServer queries"s);
+        actual = FindForEach(queries, [&](const string& query) { return sharded_server.FindTopDocuments(query); });
+    }
+    const int mismatch_count = (sharded_server.GetDocumentCount() == search_server.GetDocumentCount() ? 0 : 1)
+        + CountMismatches(expected, actual);
+    cout << "  mismatched results: "s << mismatch_count << endl;
+}
+
+void BenchmarkDuplicates(int document_count) {
+    BenchmarkCorpus corpus(20000, document_count, 30, 45);
+    // Every tenth document repeats an earlier one with its words reversed
+    // and its first word doubled
+    mt19937 generator(47);
+    for (int id = 10; id < document_count; id += 10) {
+        vector<string_view> words = SplitIntoWords(corpus.texts[uniform_int_distribution(0, id - 1)(generator)]);
+        words.push_back(words.front());
+        reverse(words.begin(), words.end());
+        string text;
+        for (const string_view word : words) {
+            text += string(word) + " "s;
+        }
+        corpus.texts[id] = move(text);
+    }
+    SearchServer search_server(""s);
+    search_server.AddDocuments(execution::par, corpus.MakeDocuments());
+
+    cout << "Duplicates among "s << document_count << " documents:"s << endl;
+    vector<int> expected;
+    {
+        LOG_DURATION_STREAM("  sets of word strings"s);
+        expected = FindDuplicatesWithWordSets(search_server);
+    }
+    vector<int> actual;
+    {
+        LOG_DURATION_STREAM("  fingerprints"s);
+        actual = FindDuplicates(search_server);
+    }
+    {
+        LOG_DURATION_STREAM("  removal"s);
+        RemoveDuplicates(search_server);
+    }
+    cout << "  duplicates: "s << actual.size() << ", same as before: "s << (expected == actual ? "yes"s : "no"s)
+        << ", left after removal: "s << FindDuplicates(search_server).size() << endl;
+}
+
+void BenchmarkNearDuplicates(int max_document_count) {
+    cout << "Near-duplicates:"s << endl;
+    for (int document_count = max_document_count / 4; document_count <= max_document_count; document_count *= 2) {
+        BenchmarkCorpus corpus(50000, document_count, 60, 48);
+        // Every tenth document copies an earlier one of 20 words or more
+        // with its last word replaced
+        mt19937 generator(50);
+        vector<pair<int, int>> planted;
+        for (int id = 10; id < document_count; id += 10) {
+            const int source_id = uniform_int_distribution(0, id - 1)(generator);
+            const vector<string_view> words = SplitIntoWords(corpus.texts[source_id]);
+            if (words.size() < 20 || source_id % 10 == 0) {
+                continue;
+            }
+            string text;
+            for (size_t i = 0; i + 1 < words.size(); ++i) {
+                text += string(words[i]) + " "s;
+            }
+            corpus.texts[id] = move(text) + "planted"s + to_string(id);
+            planted.emplace_back(source_id, id);
+        }
+        SearchServer search_server(""s);
+        search_server.AddDocuments(execution::par, corpus.MakeDocuments());
+
+        cout << "  "s << document_count << " documents:"s << endl;
+        optional<NearDuplicateDetector> detector;
+        {
+            LOG_DURATION_STREAM("    signatures and bands"s);
+            detector.emplace(search_server);
+        }
+        vector<vector<int>> clusters;
+        size_t skipped_comparison_count = 0;
+        {
+            LOG_DURATION_STREAM("    clusters"s);
+            clusters = detector->FindClusters(skipped_comparison_count);
+        }
+        for (const auto& [source_id, id] : planted) {
+            search_server.RemoveDocument(id);
+        }
+        {
+            LOG_DURATION_STREAM("    update after removing the copies"s);
+            detector->Update();
+        }
+        for (const auto& [source_id, id] : planted) {
+            search_server.AddDocument(id, corpus.texts[id], DocumentStatus::ACTUAL, { id % 10 });
+        }
+        {
+            LOG_DURATION_STREAM("    update after adding them back"s);
+            detector->Update();
+        }
+        unordered_map<int, size_t> cluster_indices;
+        for (size_t i = 0; i < clusters.size(); ++i) {
+            for (const int id : clusters[i]) {
+                cluster_indices[id] = i;
+            }
+        }
+        const auto found_count = count_if(planted.begin(), planted.end(), [&](const pair<int, int>& pair) {
+            const auto source = cluster_indices.find(pair.first);
+            const auto copy = cluster_indices.find(pair.second);
+            return source != cluster_indices.end() && copy != cluster_indices.end() && source->second == copy->second;
+        });
+        cout << "    clusters: "s << clusters.size() << ", comparisons skipped: "s << skipped_comparison_count
+            << ", planted pairs found: "s << found_count << " of "s << planted.size()
+            << ", same after re-adding: "s << (detector->FindClusters() == clusters ? "yes"s : "no"s) << endl;
+    }
+}
+
+void RunBenchmarks(const string& scratch_directory) {
+    BenchmarkTextStorage(20000);
+    BenchmarkPostingDecode(1000000, 20);
+    BenchmarkParallelScoring(100000, 50, 3);
+    BenchmarkConcurrentMap(1000000, 10000);
+    BenchmarkMixedLoad(20000, 4, 2000);
+    BenchmarkSegmentedIngest(50000, 200);
+    BenchmarkBulkBuild(50000, 200);
+    BenchmarkIndexFile(50000, 200, scratch_directory + "/search_index.bin"s);
+    BenchmarkCorpusLoad(50000, 200, scratch_directory + "/corpus.tsv"s);
+    BenchmarkTokenizer(20000, 10);
+    BenchmarkInvalidQueries(10000, 50000);
+    BenchmarkQueryCache(20000, 50000, 2000);
+    BenchmarkPostingIntersection(50000, 500);
+    BenchmarkQueryBatch(50000, 2000);
+    BenchmarkJoinedResults(20000, 5000);
+    BenchmarkShardedSearch(50000, 500, 4);
+    BenchmarkDuplicates(50000);
+    BenchmarkNearDuplicates(40000);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "search_server.h"
+#include "concurrent_search_server.h"
+#include "segmented_search_server.h"
+#include "sharded_search_server.h"
+#include "corpus_loader.h"
+#include "process_queries.h"
+#include "query_cache.h"
+#include "remove_duplicates.h"
+#include "near_duplicates.h"
+#include "log_duration.h"
+#include "sorted_id_kernels.h"
+
+#include <string>
+#include <vector>
+
+std::vector<std::string> GenerateDictionary(int word_count, int max_length, unsigned seed);
+
+std::vector<std::string> GenerateDocuments(const std::vector<std::string>& dictionary, int document_count,
+    int max_word_count, unsigned seed);
+
+void BenchmarkTextStorage(int document_count);
+
+void BenchmarkPostingDecode(int posting_count, int repeat_count);
+
+void BenchmarkParallelScoring(int document_count, int query_count, int query_word_count);
+
+void BenchmarkConcurrentMap(int operation_count, int key_count);
+
+// Queries a ConcurrentSearchServer from several threads while another one adds
+// and removes documents, checks every result against the snapshot it came from
+// and the final index against one built from scratch
+void BenchmarkMixedLoad(int document_count, int reader_count, int write_count);
+
+// Bulk-loads the same documents into a SearchServer and a SegmentedSearchServer,
+// compares their results, then removes a third of the documents and checks
+// that none of them is returned again
+void BenchmarkSegmentedIngest(int document_count, int query_count);
+
+// Builds the same index with an AddDocument loop and with AddDocuments,
+// sequential and parallel, and checks that they answer queries identically
+void BenchmarkBulkBuild(int document_count, int query_count);
+
+// Saves an index with some removed documents, opens it again, reports the
+// file size and the time to save, open and answer the first queries, and
+// checks that the opened index answers like the original
+void BenchmarkIndexFile(int document_count, int query_count, const std::string& path);
+
+// Writes a corpus file, loads it with LoadCorpus, reports the ingest rate and
+// checks the result against AddDocuments on the same documents in memory
+void BenchmarkCorpusLoad(int document_count, int query_count, const std::string& path);
+
+// Tokenizes generated documents with SplitIntoWords and with the find(' ')
+// loop it replaced, and reports the throughput of both
+void BenchmarkTokenizer(int document_count, int repeat_count);
+
+// Runs a flood of invalid queries through the throwing FindTopDocuments and
+// through TryFindTopDocuments
+void BenchmarkInvalidQueries(int document_count, int query_count);
+
+// Runs a skewed query stream through ProcessQueries with and without a
+// QueryCache, compares the results and reports the hit rate
+void BenchmarkQueryCache(int document_count, int query_count, int distinct_query_count);
+
+// Times the sorted id kernels against plain merges, then conjunctive queries
+// against the default any-word ones, and checks the conjunctive results
+// against the any-word results filtered down to documents with every word
+void BenchmarkPostingIntersection(int document_count, int query_count);
+
+// Runs a batch with repeated and a few expensive queries through QueryBatch
+// and through independent FindTopDocuments calls, compares the results and
+// reports the batch statistics
+void BenchmarkQueryBatch(int document_count, int query_count);
+
+// Joins the results of a batch into a std::list, as ProcessQueriesJoined used
+// to, and into JoinedDocuments, and compares time, memory and contents
+void BenchmarkJoinedResults(int document_count, int query_count);
+
+// Builds the same index as one SearchServer and as a ShardedSearchServer,
+// removes some documents from both and checks that queries score exactly
+// alike
+void BenchmarkShardedSearch(int document_count, int query_count, int shard_count);
+
+// Finds planted duplicates with word set fingerprints and with the sets of
+// word strings RemoveDuplicates used before, and checks both agree
+void BenchmarkDuplicates(int document_count);
+
+// Plants copies with one word replaced among growing corpora, and times
+// NearDuplicateDetector's build, clustering and updates, which should scale
+// about linearly, and the recall of the planted pairs
+void BenchmarkNearDuplicates(int max_document_count);
+
+// Runs every benchmark above at its usual size, keeping the files they write
+// in scratch_directory
+void RunBenchmarks(const std::string& scratch_directory);
@@ -1,48 +1,153 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <mutex>
-#include <map>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
-using namespace std::string_literals;
-
-template <typename Key, typename Value>
+// Hash map split into independently locked shards. Each shard is an open
+// addressing table with linear probing and sits on its own cache lines, so
+// threads updating different shards never share a line.
+template <typename Key, typename Value, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
 class ConcurrentMap {
 private:
-	struct Bucket {
+	static constexpr size_t CACHE_LINE_SIZE = 64;
+
+	struct alignas(CACHE_LINE_SIZE) Shard {
 		std::mutex mutex;
-		std::map<Key, Value> map;
+		std::vector<std::pair<Key, Value>> slots;
+		std::vector<uint8_t> occupied;
+		size_t size = 0;
+		// Slots are picked by the top 64 - slot_shift bits of the mixed hash
+		unsigned slot_shift = 64;
 	};
 
 public:
-	static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys"s);
-
 	struct Access {
 		std::lock_guard<std::mutex> guard;
 		Value& ref_to_value;
 
-		Access(const Key& key, Bucket& bucket)
-			: guard(bucket.mutex)
-			, ref_to_value(bucket.map[key]) {
+		Access(const Key& key, Shard& shard, uint64_t hash)
+			: guard(shard.mutex)
+			, ref_to_value(FindOrInsert(shard, key, hash)) {
 		}
 	};
 
 	explicit ConcurrentMap(size_t bucket_count)
-		: buckets_(bucket_count) {
+		: shards_(bucket_count > 0 ? bucket_count : 1) {
 	}
 
 	Access operator[](const Key& key) {
-		auto& bucket = buckets_[static_cast<uint64_t>(key) % buckets_.size()];
-		return { key, bucket };
+		const uint64_t hash = MixHash(Hash{}(key));
+		return { key, GetShard(hash), hash };
+	}
+
+	// Adds delta to the value of key (inserting it first if needed) and
+	// returns the previous value
+	template <typename V = Value, typename = std::enable_if_t<std::is_arithmetic_v<V>>>
+	Value FetchAdd(const Key& key, Value delta) {
+		const uint64_t hash = MixHash(Hash{}(key));
+		Shard& shard = GetShard(hash);
+		std::lock_guard guard(shard.mutex);
+		Value& value = FindOrInsert(shard, key, hash);
+		const Value previous = value;
+		value += delta;
+		return previous;
+	}
+
+	// Visits every entry in place, locking one shard at a time
+	template <typename Function>
+	void ForEach(Function function) {
+		for (Shard& shard : shards_) {
+			std::lock_guard guard(shard.mutex);
+			for (size_t i = 0; i < shard.slots.size(); ++i) {
+				if (shard.occupied[i]) {
+					function(std::as_const(shard.slots[i].first), shard.slots[i].second);
+				}
+			}
+		}
+	}
+
+	// Moves all entries out in unspecified order and leaves the map empty
+	std::vector<std::pair<Key, Value>> MoveOut() {
+		std::vector<std::pair<Key, Value>> result;
+		result.reserve(size());
+		for (Shard& shard : shards_) {
+			std::lock_guard guard(shard.mutex);
+			for (size_t i = 0; i < shard.slots.size(); ++i) {
+				if (shard.occupied[i]) {
+					result.push_back(std::move(shard.slots[i]));
+				}
+			}
+			shard.slots.clear();
+			shard.occupied.clear();
+			shard.size = 0;
+		}
+		return result;
 	}
 
-	std::map<Key, Value> BuildOrdinaryMap() {
-		std::map<Key, Value> result;
-		for (auto& [mutex, map] : buckets_) {
-			std::lock_guard g(mutex);
-			result.insert(map.begin(), map.end());
+	size_t size() {
+		size_t result = 0;
+		for (Shard& shard : shards_) {
+			std::lock_guard guard(shard.mutex);
+			result += shard.size;
 		}
 		return result;
 	}
 
 private:
-	std::vector<Bucket> buckets_;
-};
\ No newline at end of file
+	std::vector<Shard> shards_;
+
+	// Fibonacci hashing, as in ShardedSearchServer: std::hash of an integer
+	// is the integer itself, and the multiply spreads runs of consecutive
+	// keys over every shard and slot instead of packing them into one run
+	static uint64_t MixHash(size_t hash) {
+		return static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ULL;
+	}
+
+	// Bits 32 and up pick the shard, the topmost ones the slot inside it
+	Shard& GetShard(uint64_t hash) {
+		return shards_[(hash >> 32) % shards_.size()];
+	}
+
+	static Value& FindOrInsert(Shard& shard, const Key& key, uint64_t hash) {
+		if ((shard.size + 1) * 10 > shard.slots.size() * 7) {
+			Grow(shard);
+		}
+		const size_t mask = shard.slots.size() - 1;
+		for (size_t i = static_cast<size_t>(hash >> shard.slot_shift);; i = (i + 1) & mask) {
+			if (!shard.occupied[i]) {
+				shard.occupied[i] = 1;
+				shard.slots[i] = { key, Value{} };
+				++shard.size;
+				return shard.slots[i].second;
+			}
+			if (KeyEqual{}(shard.slots[i].first, key)) {
+				return shard.slots[i].second;
+			}
+		}
+	}
+
+	static void Grow(Shard& shard) {
+		const size_t capacity = shard.slots.empty() ? 16 : shard.slots.size() * 2;
+		const unsigned slot_shift = shard.slots.empty() ? 60 : shard.slot_shift - 1;
+		std::vector<std::pair<Key, Value>> slots(capacity);
+		std::vector<uint8_t> occupied(capacity, 0);
+		for (size_t i = 0; i < shard.slots.size(); ++i) {
+			if (!shard.occupied[i]) {
+				continue;
+			}
+			size_t j = static_cast<size_t>(MixHash(Hash{}(shard.slots[i].first)) >> slot_shift);
+			while (occupied[j]) {
+				j = (j + 1) & (capacity - 1);
+			}
+			occupied[j] = 1;
+			slots[j] = std::move(shard.slots[i]);
+		}
+		shard.slots = std::move(slots);
+		shard.occupied = std::move(occupied);
+		shard.slot_shift = slot_shift;
+	}
+};
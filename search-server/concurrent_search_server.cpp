@@ -0,0 +1,96 @@
+#include "concurrent_search_server.h"
+
+ConcurrentSearchServer::Snapshot::Snapshot(const ConcurrentSearchServer* server, Replica* replica)
+    : server_(server)
+    , replica_(replica)
+{
+}
+
+ConcurrentSearchServer::Snapshot::Snapshot(Snapshot&& other) noexcept
+    : server_(other.server_)
+    , replica_(std::exchange(other.replica_, nullptr))
+{
+}
+
+ConcurrentSearchServer::Snapshot& ConcurrentSearchServer::Snapshot::operator=(Snapshot&& other) noexcept {
+    if (this != &other) {
+        if (replica_ != nullptr) {
+            server_->Release(replica_);
+        }
+        server_ = other.server_;
+        replica_ = std::exchange(other.replica_, nullptr);
+    }
+    return *this;
+}
+
+ConcurrentSearchServer::Snapshot::~Snapshot() {
+    if (replica_ != nullptr) {
+        server_->Release(replica_);
+    }
+}
+
+const SearchServer& ConcurrentSearchServer::Snapshot::operator*() const {
+    return replica_->search_server;
+}
+
+const SearchServer* ConcurrentSearchServer::Snapshot::operator->() const {
+    return &replica_->search_server;
+}
+
+ConcurrentSearchServer::ConcurrentSearchServer(const std::string& stop_words_text)
+    : ConcurrentSearchServer(std::string_view(stop_words_text))
+{
+}
+
+ConcurrentSearchServer::ConcurrentSearchServer(const std::string_view stop_words_text) {
+    replicas_.push_back(std::make_unique<Replica>(stop_words_text));
+    replicas_.push_back(std::make_unique<Replica>(replicas_.front()->search_server));
+    published_ = replicas_.front().get();
+    standby_ = replicas_.back().get();
+}
+
+void ConcurrentSearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+    Apply([&](SearchServer& search_server) {
+        search_server.AddDocument(document_id, document, status, ratings);
+    });
+}
+
+void ConcurrentSearchServer::RemoveDocument(int document_id) {
+    Apply([document_id](SearchServer& search_server) {
+        search_server.RemoveDocument(document_id);
+    });
+}
+
+ConcurrentSearchServer::Snapshot ConcurrentSearchServer::GetSnapshot() const {
+    for (;;) {
+        Replica* replica = published_.load();
+        replica->reader_count.fetch_add(1);
+        // A writer that swapped the copies in between may already have seen
+        // no readers, so the copy has to still be the published one
+        if (published_.load() == replica) {
+            return Snapshot(this, replica);
+        }
+        Release(replica);
+    }
+}
+
+int ConcurrentSearchServer::GetDocumentCount() const {
+    return GetSnapshot()->GetDocumentCount();
+}
+
+void ConcurrentSearchServer::Release(Replica* replica) const {
+    if (replica->reader_count.fetch_sub(1) == 1 && writer_waiting_.load()) {
+        std::lock_guard guard(release_mutex_);
+        released_.notify_all();
+    }
+}
+
+void ConcurrentSearchServer::WaitForReaders(const Replica& replica) {
+    if (replica.reader_count.load() == 0) {
+        return;
+    }
+    std::unique_lock lock(release_mutex_);
+    writer_waiting_ = true;
+    released_.wait(lock, [&replica] { return replica.reader_count.load() == 0; });
+    writer_waiting_ = false;
+}
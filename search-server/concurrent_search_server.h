@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+// SearchServer that can be queried while documents are added and removed.
+// Two copies of the index are kept: readers work on the published one,
+// a writer updates the other, publishes it, waits until the readers of
+// the previous copy are gone and replays the same change there. Queries
+// never wait for writers; a writer waits at most for the queries that
+// were already running on the old copy.
+class ConcurrentSearchServer {
+private:
+    struct Replica;
+
+public:
+    // An immutable view of the index, released when the snapshot is
+    // destroyed
+    class Snapshot {
+    public:
+        Snapshot(Snapshot&& other) noexcept;
+        Snapshot& operator=(Snapshot&& other) noexcept;
+
+        ~Snapshot();
+
+        const SearchServer& operator*() const;
+        const SearchServer* operator->() const;
+
+    private:
+        friend class ConcurrentSearchServer;
+
+        const ConcurrentSearchServer* server_;
+        Replica* replica_;
+
+        Snapshot(const ConcurrentSearchServer* server, Replica* replica);
+    };
+
+    template <typename StringContainer>
+    explicit ConcurrentSearchServer(const StringContainer& stop_words);
+
+    explicit ConcurrentSearchServer(const std::string& stop_words_text);
+
+    explicit ConcurrentSearchServer(const std::string_view stop_words_text);
+
+    ConcurrentSearchServer(const ConcurrentSearchServer&) = delete;
+    ConcurrentSearchServer& operator=(const ConcurrentSearchServer&) = delete;
+
+    void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    void RemoveDocument(int document_id);
+
+    // Keep a snapshot only as long as needed: writers wait for every
+    // snapshot of the copy they are about to update.
+    Snapshot GetSnapshot() const;
+
+    template <typename... Args>
+    std::vector<Document> FindTopDocuments(Args&&... args) const;
+
+    // Matched words point into storage that lives as long as this server
+    template <typename... Args>
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(Args&&... args) const;
+
+    int GetDocumentCount() const;
+
+private:
+    struct Replica {
+        template <typename... Args>
+        explicit Replica(Args&&... args)
+            : search_server(std::forward<Args>(args)...)
+        {
+        }
+
+        SearchServer search_server;
+        // Snapshots of this copy still alive
+        std::atomic<int> reader_count = 0;
+    };
+
+    std::mutex write_mutex_;
+    std::atomic<Replica*> published_;
+    Replica* standby_;
+    // Every copy ever made, so that words returned by MatchDocument stay
+    // valid: a copy whose replay failed is kept here, never freed
+    std::vector<std::unique_ptr<Replica>> replicas_;
+    // The writer sleeps here until the last reader of the previous copy
+    // leaves; readers only take the mutex when a writer waits
+    mutable std::mutex release_mutex_;
+    mutable std::condition_variable released_;
+    mutable std::atomic<bool> writer_waiting_ = false;
+
+    void Release(Replica* replica) const;
+
+    void WaitForReaders(const Replica& replica);
+
+    template <typename Change>
+    void Apply(Change change);
+};
+
+template <typename StringContainer>
+ConcurrentSearchServer::ConcurrentSearchServer(const StringContainer& stop_words) {
+    replicas_.push_back(std::make_unique<Replica>(stop_words));
+    replicas_.push_back(std::make_unique<Replica>(replicas_.front()->search_server));
+    published_ = replicas_.front().get();
+    standby_ = replicas_.back().get();
+}
+
+template <typename... Args>
+std::vector<Document> ConcurrentSearchServer::FindTopDocuments(Args&&... args) const {
+    return GetSnapshot()->FindTopDocuments(std::forward<Args>(args)...);
+}
+
+template <typename... Args>
+std::tuple<std::vector<std::string_view>, DocumentStatus> ConcurrentSearchServer::MatchDocument(Args&&... args) const {
+    return GetSnapshot()->MatchDocument(std::forward<Args>(args)...);
+}
+
+template <typename Change>
+void ConcurrentSearchServer::Apply(Change change) {
+    std::lock_guard guard(write_mutex_);
+    // Nothing is published if the change is rejected
+    change(standby_->search_server);
+    standby_ = published_.exchange(standby_);
+    WaitForReaders(*standby_);
+    try {
+        change(standby_->search_server);
+    }
+    catch (...) {
+        // Readers may still hold words of the half-changed copy, so it is
+        // retired rather than freed
+        replicas_.push_back(std::make_unique<Replica>(published_.load()->search_server));
+        standby_ = replicas_.back().get();
+        throw;
+    }
+}
@@ -0,0 +1,267 @@
+#include "corpus_loader.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using std::string_literals::operator""s;
+
+namespace {
+
+// Whole lines read from the input and the documents parsed from them. Texts
+// point into bytes, so a block goes back to the pool only once indexed.
+struct CorpusBlock {
+    std::vector<char> bytes;
+    std::vector<NewDocument> documents;
+};
+
+int ParseNumber(std::string_view text, size_t line_number) {
+    int value = 0;
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || end != text.data() + text.size() || text.empty()) {
+        throw std::invalid_argument("Invalid number in corpus line "s + std::to_string(line_number));
+    }
+    return value;
+}
+
+DocumentStatus ParseStatus(std::string_view text, size_t line_number) {
+    static constexpr std::string_view STATUS_NAMES[] = { "ACTUAL", "IRRELEVANT", "BANNED", "REMOVED" };
+    const auto it = std::find(std::begin(STATUS_NAMES), std::end(STATUS_NAMES), text);
+    if (it == std::end(STATUS_NAMES)) {
+        throw std::invalid_argument("Invalid status in corpus line "s + std::to_string(line_number));
+    }
+    return static_cast<DocumentStatus>(it - std::begin(STATUS_NAMES));
+}
+
+// Cuts the next tab separated field off the front of line
+std::string_view TakeField(std::string_view& line, size_t line_number) {
+    const size_t tab = line.find('\t');
+    if (tab == line.npos) {
+        throw std::invalid_argument("Missing field in corpus line "s + std::to_string(line_number));
+    }
+    const std::string_view field = line.substr(0, tab);
+    line.remove_prefix(tab + 1);
+    return field;
+}
+
+void ParseLine(std::string_view line, size_t line_number, NewDocument& document) {
+    document.id = ParseNumber(TakeField(line, line_number), line_number);
+    document.status = ParseStatus(TakeField(line, line_number), line_number);
+    std::string_view ratings = TakeField(line, line_number);
+    document.ratings.clear();
+    while (!ratings.empty()) {
+        const size_t space = std::min(ratings.find(' '), ratings.size());
+        if (space > 0) {
+            document.ratings.push_back(ParseNumber(ratings.substr(0, space), line_number));
+        }
+        ratings.remove_prefix(std::min(space + 1, ratings.size()));
+    }
+    document.text = line;
+}
+
+// Reader thread and the bounded queues between it and the indexing thread.
+// Blocks circulate between free_ and ready_, which is what limits memory
+// and makes the reader wait for the index.
+class CorpusPipeline {
+public:
+    CorpusPipeline(std::istream& input, const CorpusLoadOptions& options)
+        : input_(input)
+        , block_size_(std::max<size_t>(options.block_size, 1))
+        , blocks_(std::max<size_t>(options.max_pending_blocks, 1) + 1)
+    {
+        for (CorpusBlock& block : blocks_) {
+            free_.push_back(&block);
+        }
+        reader_ = std::thread([this] { Read(); });
+    }
+
+    CorpusPipeline(const CorpusPipeline&) = delete;
+    CorpusPipeline& operator=(const CorpusPipeline&) = delete;
+
+    ~CorpusPipeline() {
+        {
+            std::lock_guard guard(mutex_);
+            stopping_ = true;
+        }
+        changed_.notify_all();
+        reader_.join();
+    }
+
+    // Next parsed block, or nullptr at the end of input
+    CorpusBlock* Pop() {
+        std::unique_lock lock(mutex_);
+        changed_.wait(lock, [this] { return !ready_.empty() || finished_; });
+        if (!ready_.empty()) {
+            CorpusBlock* block = ready_.front();
+            ready_.pop_front();
+            changed_.notify_all();
+            return block;
+        }
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        return nullptr;
+    }
+
+    void Release(CorpusBlock* block) {
+        {
+            std::lock_guard guard(mutex_);
+            free_.push_back(block);
+        }
+        changed_.notify_all();
+    }
+
+    uint64_t GetByteCount() const {
+        return byte_count_;
+    }
+
+private:
+    std::istream& input_;
+    const size_t block_size_;
+    std::vector<CorpusBlock> blocks_;
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::deque<CorpusBlock*> free_;
+    std::deque<CorpusBlock*> ready_;
+    bool stopping_ = false;
+    bool finished_ = false;
+    std::exception_ptr error_;
+    // Written by the reader before it finishes
+    uint64_t byte_count_ = 0;
+
+    std::thread reader_;
+
+    CorpusBlock* AcquireFree() {
+        std::unique_lock lock(mutex_);
+        changed_.wait(lock, [this] { return !free_.empty() || stopping_; });
+        if (stopping_) {
+            return nullptr;
+        }
+        CorpusBlock* block = free_.front();
+        free_.pop_front();
+        return block;
+    }
+
+    void Read() {
+        try {
+            ReadBlocks();
+        } catch (...) {
+            std::lock_guard guard(mutex_);
+            error_ = std::current_exception();
+        }
+        {
+            std::lock_guard guard(mutex_);
+            finished_ = true;
+        }
+        changed_.notify_all();
+    }
+
+    void ReadBlocks() {
+        // Unfinished last line of the previous read
+        std::vector<char> carry;
+        size_t line_number = 0;
+        for (bool at_end = false; !at_end;) {
+            CorpusBlock* block = AcquireFree();
+            if (block == nullptr) {
+                return;
+            }
+            std::vector<char>& bytes = block->bytes;
+            bytes.resize(carry.size() + block_size_);
+            std::copy(carry.begin(), carry.end(), bytes.begin());
+            input_.read(bytes.data() + carry.size(), static_cast<std::streamsize>(block_size_));
+            const size_t read_size = static_cast<size_t>(input_.gcount());
+            byte_count_ += read_size;
+            size_t size = carry.size() + read_size;
+            at_end = !input_;
+            if (input_.bad()) {
+                throw std::runtime_error("Can't read corpus"s);
+            }
+            bytes.resize(size);
+
+            size_t lines_end = size;
+            if (!at_end) {
+                const auto last_newline = std::find(bytes.rbegin(), bytes.rend(), '\n');
+                lines_end = static_cast<size_t>(bytes.rend() - last_newline);
+            }
+            carry.assign(bytes.begin() + lines_end, bytes.end());
+            bytes.resize(lines_end);
+
+            size_t document_count = 0;
+            for (std::string_view rest(bytes.data(), bytes.size()); !rest.empty();) {
+                const size_t newline = std::min(rest.find('\n'), rest.size());
+                std::string_view line = rest.substr(0, newline);
+                rest.remove_prefix(std::min(newline + 1, rest.size()));
+                ++line_number;
+                if (!line.empty() && line.back() == '\r') {
+                    line.remove_suffix(1);
+                }
+                if (line.empty()) {
+                    continue;
+                }
+                // Documents are reused to keep their ratings buffers
+                if (document_count == block->documents.size()) {
+                    block->documents.emplace_back();
+                }
+                ParseLine(line, line_number, block->documents[document_count++]);
+            }
+            block->documents.resize(document_count);
+
+            {
+                std::lock_guard guard(mutex_);
+                (document_count > 0 ? ready_ : free_).push_back(block);
+            }
+            changed_.notify_all();
+        }
+    }
+};
+
+}
+
+double CorpusLoadStatistics::GetDocumentsPerSecond() const {
+    return seconds > 0.0 ? document_count / seconds : 0.0;
+}
+
+double CorpusLoadStatistics::GetMegabytesPerSecond() const {
+    return seconds > 0.0 ? byte_count / seconds / (1 << 20) : 0.0;
+}
+
+std::ostream& operator<<(std::ostream& out, const CorpusLoadStatistics& statistics) {
+    return out << statistics.document_count << " documents, "s << statistics.byte_count / (1 << 20) << " MB in "s
+        << statistics.seconds << " s: "s << statistics.GetDocumentsPerSecond() << " docs/s, "s
+        << statistics.GetMegabytesPerSecond() << " MB/s"s;
+}
+
+CorpusLoadStatistics LoadCorpus(SearchServer& search_server, std::istream& input, const CorpusLoadOptions& options) {
+    const auto start = std::chrono::steady_clock::now();
+    CorpusLoadStatistics statistics;
+    {
+        CorpusPipeline pipeline(input, options);
+        while (CorpusBlock* block = pipeline.Pop()) {
+            search_server.AddDocuments(std::execution::par, block->documents);
+            statistics.document_count += block->documents.size();
+            pipeline.Release(block);
+        }
+        statistics.byte_count = pipeline.GetByteCount();
+    }
+    statistics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return statistics;
+}
+
+CorpusLoadStatistics LoadCorpus(SearchServer& search_server, const std::string& path, const CorpusLoadOptions& options) {
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        throw std::runtime_error("Can't open corpus file "s + path);
+    }
+    return LoadCorpus(search_server, input, options);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+
+#include "search_server.h"
+
+// Corpus files hold one document per line with four tab separated fields:
+//   id <TAB> status <TAB> space separated ratings <TAB> text
+// where status is ACTUAL, IRRELEVANT, BANNED or REMOVED. Empty lines are
+// skipped and a trailing '\r' is ignored.
+struct CorpusLoadOptions {
+    // Bytes read at a time. A line longer than this still loads, in a
+    // buffer grown to fit it.
+    size_t block_size = 4 << 20;
+    // Blocks read ahead of the index. Reading pauses while all of them wait,
+    // so memory stays around (max_pending_blocks + 1) * block_size.
+    size_t max_pending_blocks = 3;
+};
+
+struct CorpusLoadStatistics {
+    size_t document_count = 0;
+    uint64_t byte_count = 0;
+    double seconds = 0.0;
+
+    double GetDocumentsPerSecond() const;
+
+    double GetMegabytesPerSecond() const;
+};
+
+std::ostream& operator<<(std::ostream& out, const CorpusLoadStatistics& statistics);
+
+// Reads the corpus on a background thread and adds each block to the index
+// with the parallel AddDocuments. Throws std::invalid_argument on a malformed
+// line and whatever AddDocuments throws; blocks before the failing one stay
+// added.
+CorpusLoadStatistics LoadCorpus(SearchServer& search_server, std::istream& input, const CorpusLoadOptions& options = {});
+
+CorpusLoadStatistics LoadCorpus(SearchServer& search_server, const std::string& path, const CorpusLoadOptions& options = {});
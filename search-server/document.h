@@ -1,6 +1,7 @@
 #pragma once
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 struct Document {
@@ -22,4 +23,12 @@ enum class DocumentStatus {
     REMOVED,
 };
 
+// Everything AddDocument takes, for adding documents in batches
+struct NewDocument {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
+
 void PrintMatchDocumentResult(int document_id, const std::vector<std::string>& words, DocumentStatus status);
\ No newline at end of file
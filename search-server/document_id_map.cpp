@@ -0,0 +1,73 @@
+#include "document_id_map.h"
+
+#include <algorithm>
+
+DocumentIdMap DocumentIdMap::Map(const Entry* entries, size_t count) {
+    DocumentIdMap map;
+    map.mapped_entries_ = entries;
+    map.mapped_count_ = count;
+    return map;
+}
+
+std::optional<uint32_t> DocumentIdMap::Find(int document_id) const {
+    if (mapped_entries_) {
+        const Entry* end = mapped_entries_ + mapped_count_;
+        const Entry* it = std::lower_bound(mapped_entries_, end, document_id,
+            [](const Entry& entry, int value) { return entry.document_id < value; });
+        if (it == end || it->document_id != document_id) {
+            return std::nullopt;
+        }
+        return it->internal_id;
+    }
+    const auto it = internal_ids_.find(document_id);
+    if (it == internal_ids_.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+bool DocumentIdMap::Contains(int document_id) const {
+    return Find(document_id).has_value();
+}
+
+void DocumentIdMap::Add(int document_id, uint32_t internal_id) {
+    Detach();
+    internal_ids_.emplace(document_id, internal_id);
+    document_ids_.insert(document_ids_.end(), document_id);
+}
+
+void DocumentIdMap::Remove(int document_id) {
+    Detach();
+    internal_ids_.erase(document_id);
+    document_ids_.erase(document_id);
+}
+
+void DocumentIdMap::Reserve(size_t count) {
+    Detach();
+    internal_ids_.reserve(count);
+}
+
+size_t DocumentIdMap::size() const {
+    return mapped_entries_ ? mapped_count_ : internal_ids_.size();
+}
+
+DocumentIdMap::Iterator DocumentIdMap::begin() const {
+    return mapped_entries_ ? Iterator(mapped_entries_, document_ids_.end()) : Iterator(nullptr, document_ids_.begin());
+}
+
+DocumentIdMap::Iterator DocumentIdMap::end() const {
+    return mapped_entries_ ? Iterator(mapped_entries_ + mapped_count_, document_ids_.end()) : Iterator(nullptr, document_ids_.end());
+}
+
+void DocumentIdMap::Detach() {
+    if (!mapped_entries_) {
+        return;
+    }
+    internal_ids_.reserve(mapped_count_);
+    for (size_t i = 0; i < mapped_count_; ++i) {
+        internal_ids_.emplace(mapped_entries_[i].document_id, mapped_entries_[i].internal_id);
+        document_ids_.insert(document_ids_.end(), mapped_entries_[i].document_id);
+    }
+    mapped_entries_ = nullptr;
+    mapped_count_ = 0;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <set>
+#include <unordered_map>
+
+// Internal ids of the live documents by external id, iterable in id order.
+// It can start out as a view of an array of entries sorted by document id
+// in a mapped index file, which is copied into a hash map and an ordered
+// set before it's first changed. The array must outlive the map and all
+// of its copies.
+class DocumentIdMap {
+public:
+    struct Entry {
+        int32_t document_id;
+        uint32_t internal_id;
+    };
+
+    // Visits the document ids in ascending order
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = int;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const int*;
+        using reference = const int&;
+
+        reference operator*() const {
+            return entry_ ? entry_->document_id : *it_;
+        }
+
+        Iterator& operator++() {
+            if (entry_) {
+                ++entry_;
+            }
+            else {
+                ++it_;
+            }
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return entry_ == other.entry_ && it_ == other.it_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        friend class DocumentIdMap;
+
+        Iterator(const Entry* entry, std::set<int>::const_iterator it)
+            : entry_(entry)
+            , it_(it) {
+        }
+
+        const Entry* entry_;
+        std::set<int>::const_iterator it_;
+    };
+
+    static DocumentIdMap Map(const Entry* entries, size_t count);
+
+    std::optional<uint32_t> Find(int document_id) const;
+
+    bool Contains(int document_id) const;
+
+    // The document id must not be in the map yet
+    void Add(int document_id, uint32_t internal_id);
+
+    void Remove(int document_id);
+
+    void Reserve(size_t count);
+
+    size_t size() const;
+
+    Iterator begin() const;
+
+    Iterator end() const;
+
+private:
+    std::unordered_map<int, uint32_t> internal_ids_;
+    std::set<int> document_ids_;
+    // Used instead of the containers above while the entries are in a mapped file
+    const Entry* mapped_entries_ = nullptr;
+    size_t mapped_count_ = 0;
+
+    void Detach();
+};
@@ -0,0 +1,39 @@
+#include "forward_index.h"
+
+#include <algorithm>
+
+ForwardIndex::ForwardIndex() {
+    offsets_.push_back(0);
+}
+
+void ForwardIndex::Add(Terms terms) {
+    entries_.insert(entries_.end(), terms.begin(), terms.end());
+    offsets_.push_back(entries_.size());
+}
+
+void ForwardIndex::Reserve(size_t document_count, size_t entry_count) {
+    offsets_.reserve(offsets_.size() + document_count);
+    entries_.reserve(entries_.size() + entry_count);
+}
+
+ForwardIndex::Terms ForwardIndex::GetTerms(uint32_t internal_id) const {
+    return { entries_.data() + offsets_[internal_id], entries_.data() + offsets_[internal_id + 1] };
+}
+
+uint32_t ForwardIndex::GetTermCount(uint32_t internal_id, TermId term_id) const {
+    const Terms terms = GetTerms(internal_id);
+    const ForwardEntry* it = std::lower_bound(terms.begin(), terms.end(), term_id,
+        [](const ForwardEntry& entry, TermId value) { return entry.term_id < value; });
+    return it != terms.end() && it->term_id == term_id ? it->term_count : 0;
+}
+
+size_t ForwardIndex::size() const {
+    return offsets_.size() - 1;
+}
+
+ForwardIndex ForwardIndex::Map(const uint64_t* offsets, const ForwardEntry* entries, size_t document_count) {
+    ForwardIndex index;
+    index.offsets_ = MappedVector<uint64_t>::Map(offsets, document_count + 1);
+    index.entries_ = MappedVector<ForwardEntry>::Map(entries, offsets[document_count]);
+    return index;
+}
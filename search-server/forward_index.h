@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mapped_vector.h"
+#include "term_dictionary.h"
+
+struct ForwardEntry {
+    TermId term_id;
+    uint32_t term_count;
+};
+
+// Term occurrence counts of every document, by internal id, in two flat
+// arrays: the entries of document i are [offsets[i], offsets[i + 1]),
+// sorted by term id. Removed documents keep their entries.
+class ForwardIndex {
+public:
+    // Entries of one document
+    class Terms {
+    public:
+        Terms(const ForwardEntry* first, const ForwardEntry* last)
+            : first_(first)
+            , last_(last) {
+        }
+
+        const ForwardEntry* begin() const {
+            return first_;
+        }
+
+        const ForwardEntry* end() const {
+            return last_;
+        }
+
+        size_t size() const {
+            return last_ - first_;
+        }
+
+        bool empty() const {
+            return first_ == last_;
+        }
+
+    private:
+        const ForwardEntry* first_;
+        const ForwardEntry* last_;
+    };
+
+    ForwardIndex();
+
+    // Appends the next document; terms must be sorted by term id
+    void Add(Terms terms);
+
+    void Reserve(size_t document_count, size_t entry_count);
+
+    Terms GetTerms(uint32_t internal_id) const;
+
+    // Zero if the document doesn't contain the term
+    uint32_t GetTermCount(uint32_t internal_id, TermId term_id) const;
+
+    // Number of documents
+    size_t size() const;
+
+    // Uses the arrays of an index file in place until a document is added;
+    // offsets has document_count + 1 elements
+    static ForwardIndex Map(const uint64_t* offsets, const ForwardEntry* entries, size_t document_count);
+
+private:
+    MappedVector<uint64_t> offsets_;
+    MappedVector<ForwardEntry> entries_;
+};
@@ -0,0 +1,233 @@
+#include "index_file.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using std::string_literals::operator""s;
+
+namespace {
+
+constexpr char MAGIC[8] = { 'S', 'R', 'C', 'H', 'I', 'D', 'X', '\0' };
+constexpr uint32_t VERSION = 3;
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+constexpr size_t ALIGNMENT = 8;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order_mark;
+    uint64_t table_offset;
+    uint64_t section_count;
+    uint64_t table_checksum;
+};
+
+}
+
+uint64_t ComputeChecksum(const void* data, size_t size, uint64_t checksum) {
+    // FNV-1a
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        checksum = (checksum ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return checksum;
+}
+
+IndexFileWriter::IndexFileWriter(const std::string& path)
+    : path_(path)
+    , temporary_path_(path + ".tmp"s)
+    , out_(temporary_path_, std::ios::binary | std::ios::trunc)
+{
+    if (!out_) {
+        throw std::runtime_error("Can't create index file "s + temporary_path_);
+    }
+    const Header header{};
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    position_ = sizeof(header);
+}
+
+void IndexFileWriter::BeginSection(IndexSection section) {
+    Align();
+    table_.push_back({ static_cast<uint32_t>(section), 0, position_, 0, 0 });
+    section_checksum_ = ComputeChecksum(nullptr, 0);
+}
+
+void IndexFileWriter::Write(const void* data, size_t size) {
+    out_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    section_checksum_ = ComputeChecksum(data, size, section_checksum_);
+    position_ += size;
+}
+
+void IndexFileWriter::Align() {
+    static constexpr uint8_t PADDING[ALIGNMENT] = {};
+    Write(PADDING, (ALIGNMENT - position_ % ALIGNMENT) % ALIGNMENT);
+}
+
+uint64_t IndexFileWriter::GetSectionSize() const {
+    return position_ - table_.back().offset;
+}
+
+void IndexFileWriter::EndSection() {
+    Align();
+    table_.back().size = GetSectionSize();
+    table_.back().checksum = section_checksum_;
+}
+
+void IndexFileWriter::Finish() {
+    Header header{};
+    std::copy(std::begin(MAGIC), std::end(MAGIC), header.magic);
+    header.version = VERSION;
+    header.byte_order_mark = BYTE_ORDER_MARK;
+    header.table_offset = position_;
+    header.section_count = table_.size();
+    header.table_checksum = ComputeChecksum(table_.data(), table_.size() * sizeof(IndexSectionEntry));
+    out_.write(reinterpret_cast<const char*>(table_.data()), static_cast<std::streamsize>(table_.size() * sizeof(IndexSectionEntry)));
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out_.close();
+    if (!out_) {
+        throw std::runtime_error("Can't write index file "s + temporary_path_);
+    }
+#if !defined(_WIN32)
+    const int descriptor = open(temporary_path_.c_str(), O_RDONLY);
+    const bool synced = descriptor >= 0 && fsync(descriptor) == 0;
+    if (descriptor >= 0) {
+        close(descriptor);
+    }
+    if (!synced) {
+        throw std::runtime_error("Can't write index file "s + temporary_path_);
+    }
+#endif
+    std::error_code error;
+    std::filesystem::rename(temporary_path_, path_, error);
+    if (error) {
+        throw std::runtime_error("Can't replace index file "s + path_ + ": "s + error.message());
+    }
+    temporary_path_.clear();
+#if !defined(_WIN32)
+    // Makes the rename itself durable
+    const std::filesystem::path directory = std::filesystem::absolute(path_).parent_path();
+    const int directory_descriptor = open(directory.c_str(), O_RDONLY);
+    if (directory_descriptor >= 0) {
+        fsync(directory_descriptor);
+        close(directory_descriptor);
+    }
+#endif
+}
+
+IndexFileWriter::~IndexFileWriter() {
+    if (!temporary_path_.empty()) {
+        out_.close();
+        std::remove(temporary_path_.c_str());
+    }
+}
+
+IndexFile::IndexFile(const std::string& path) {
+#if defined(_WIN32)
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Can't open index file "s + path);
+    }
+    buffer_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#else
+    const int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        throw std::runtime_error("Can't open index file "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(descriptor, &file_stat) == 0 && file_stat.st_size > 0) {
+        size_ = static_cast<size_t>(file_stat.st_size);
+        void* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        data_ = mapping == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(mapping);
+    }
+    // The mapping stays valid after the descriptor is closed
+    close(descriptor);
+    if (data_ == nullptr) {
+        throw std::runtime_error("Can't map index file "s + path);
+    }
+#endif
+
+    Header header;
+    if (size_ < sizeof(header)) {
+        throw std::runtime_error("Index file is truncated"s);
+    }
+    std::memcpy(&header, data_, sizeof(header));
+    if (!std::equal(std::begin(MAGIC), std::end(MAGIC), header.magic)) {
+        throw std::runtime_error("Not an index file"s);
+    }
+    if (header.byte_order_mark != BYTE_ORDER_MARK || header.version != VERSION) {
+        throw std::runtime_error("Unsupported index file version"s);
+    }
+    if (header.table_offset > size_ || header.section_count > (size_ - header.table_offset) / sizeof(IndexSectionEntry)) {
+        throw std::runtime_error("Index file is truncated"s);
+    }
+    sections_.resize(header.section_count);
+    std::memcpy(sections_.data(), data_ + header.table_offset, sections_.size() * sizeof(IndexSectionEntry));
+    if (ComputeChecksum(sections_.data(), sections_.size() * sizeof(IndexSectionEntry)) != header.table_checksum) {
+        throw std::runtime_error("Index file section table is corrupted"s);
+    }
+    for (const IndexSectionEntry& section : sections_) {
+        if (section.offset % ALIGNMENT != 0 || section.offset > header.table_offset
+            || section.size > header.table_offset - section.offset) {
+            throw std::runtime_error("Index file section table is corrupted"s);
+        }
+    }
+}
+
+IndexFile::~IndexFile() {
+#if !defined(_WIN32)
+    munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+}
+
+IndexFile::Bytes IndexFile::GetSection(IndexSection section) const {
+    const IndexSectionEntry& entry = FindSection(section);
+    return { data_ + entry.offset, static_cast<size_t>(entry.size) };
+}
+
+void IndexFile::VerifySection(IndexSection section) const {
+    const IndexSectionEntry& entry = FindSection(section);
+    if (ComputeChecksum(data_ + entry.offset, entry.size) != entry.checksum) {
+        throw std::runtime_error("Index file section "s + std::to_string(entry.id) + " is corrupted"s);
+    }
+}
+
+const IndexSectionEntry& IndexFile::FindSection(IndexSection section) const {
+    const auto it = std::find_if(sections_.begin(), sections_.end(), [section](const IndexSectionEntry& entry) {
+        return entry.id == static_cast<uint32_t>(section);
+    });
+    if (it == sections_.end()) {
+        throw std::runtime_error("Index file has no section "s + std::to_string(static_cast<uint32_t>(section)));
+    }
+    return *it;
+}
+
+IndexSectionReader::IndexSectionReader(IndexFile::Bytes bytes)
+    : bytes_(bytes)
+{
+}
+
+const uint8_t* IndexSectionReader::Skip(size_t size) {
+    if (size > bytes_.size - position_) {
+        throw std::runtime_error("Index file section is truncated"s);
+    }
+    const uint8_t* position = bytes_.data + position_;
+    position_ += size;
+    return position;
+}
+
+void IndexSectionReader::Align() {
+    Skip((ALIGNMENT - position_ % ALIGNMENT) % ALIGNMENT);
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Binary index file: a header, the sections, then a table locating them.
+// Sections start at multiples of 8 bytes and each one has its own
+// checksum. Numbers keep the byte order of the machine that wrote them;
+// the header records it so that a foreign file is rejected.
+enum class IndexSection : uint32_t {
+    STOP_WORDS = 1,
+    TERMS,
+    // 3 held maximum term frequencies up to version 2
+    POSTING_OFFSETS = 4,
+    POSTINGS,
+    DOCUMENTS,
+    FORWARD_INDEX,
+};
+
+struct IndexSectionEntry {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t checksum;
+};
+
+uint64_t ComputeChecksum(const void* data, size_t size, uint64_t checksum = 0xcbf29ce484222325ULL);
+
+// Writes path + ".tmp" and renames it over path once finished, so that the
+// old file, which an opened server may still have mapped, is replaced
+// whole instead of truncated. An unfinished file is deleted.
+class IndexFileWriter {
+public:
+    explicit IndexFileWriter(const std::string& path);
+
+    IndexFileWriter(const IndexFileWriter&) = delete;
+    IndexFileWriter& operator=(const IndexFileWriter&) = delete;
+
+    ~IndexFileWriter();
+
+    void BeginSection(IndexSection section);
+
+    void Write(const void* data, size_t size);
+
+    template <typename T>
+    void WriteValue(const T& value) {
+        Write(&value, sizeof(value));
+    }
+
+    // Pads the current section to a multiple of 8 bytes
+    void Align();
+
+    // Bytes written to the current section so far
+    uint64_t GetSectionSize() const;
+
+    void EndSection();
+
+    // Writes the section table and the header, flushes the file to disk and
+    // moves it to path; nothing is at path before
+    void Finish();
+
+private:
+    std::string path_;
+    std::string temporary_path_;
+    std::ofstream out_;
+    std::vector<IndexSectionEntry> table_;
+    uint64_t position_ = 0;
+    uint64_t section_checksum_ = 0;
+};
+
+// A read-only index file mapped into memory. Section bytes stay valid for
+// the lifetime of the object.
+class IndexFile {
+public:
+    struct Bytes {
+        const uint8_t* data;
+        size_t size;
+    };
+
+    // Checks the header and the section table, not the section checksums
+    explicit IndexFile(const std::string& path);
+
+    IndexFile(const IndexFile&) = delete;
+    IndexFile& operator=(const IndexFile&) = delete;
+
+    ~IndexFile();
+
+    Bytes GetSection(IndexSection section) const;
+
+    void VerifySection(IndexSection section) const;
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    // Holds the file on systems without mmap
+    std::vector<uint8_t> buffer_;
+    std::vector<IndexSectionEntry> sections_;
+
+    const IndexSectionEntry& FindSection(IndexSection section) const;
+};
+
+// Bounds-checked sequential reads from a section
+class IndexSectionReader {
+public:
+    explicit IndexSectionReader(IndexFile::Bytes bytes);
+
+    template <typename T>
+    T ReadValue() {
+        T value;
+        std::memcpy(&value, Skip(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    // Returns the current position and moves past size bytes
+    const uint8_t* Skip(size_t size);
+
+    void Align();
+
+private:
+    IndexFile::Bytes bytes_;
+    size_t position_ = 0;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "document.h"
+#include "paginator.h"
+
+// Results of a batch of queries, back to back in one buffer: those of query
+// i are [offsets_[i], offsets_[i + 1]). Iterates over all of them in query
+// order, or over one query's at a time.
+class JoinedDocuments {
+public:
+    using const_iterator = const Document*;
+
+    JoinedDocuments()
+        : offsets_{ 0 }
+    {
+    }
+
+    // Takes over documents filled in place; offsets has one more element
+    // than there are queries and starts with 0
+    JoinedDocuments(std::vector<Document> documents, std::vector<size_t> offsets)
+        : documents_(std::move(documents))
+        , offsets_(std::move(offsets))
+    {
+    }
+
+    const_iterator begin() const {
+        return documents_.data();
+    }
+
+    const_iterator end() const {
+        return documents_.data() + documents_.size();
+    }
+
+    size_t size() const {
+        return documents_.size();
+    }
+
+    bool empty() const {
+        return documents_.empty();
+    }
+
+    size_t GetQueryCount() const {
+        return offsets_.size() - 1;
+    }
+
+    IteratorRange<const_iterator> GetQueryDocuments(size_t query_index) const {
+        return { begin() + offsets_[query_index], begin() + offsets_[query_index + 1] };
+    }
+
+private:
+    std::vector<Document> documents_;
+    std::vector<size_t> offsets_;
+};
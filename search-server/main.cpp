@@ -6,11 +6,18 @@
 #include <string>
 #include <vector>
 #include "test_example_functions.h"
+#include "benchmark_functions.h"
 using namespace std;
 
 
 
-int main() {
+int main(int argc, char* argv[]) {
+    // The benchmarks take minutes, so they only run when asked for
+    if (argc > 1 && argv[1] == "--benchmark"s) {
+        RunBenchmarks(argc > 2 ? argv[2] : "."s);
+        return 0;
+    }
+
     SearchServer search_server("and with"s);
 
     int id = 0;
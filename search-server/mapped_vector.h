@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// A vector that can start out as a view of an array in a mapped index
+// file, and copies the array into memory before it's first changed. The
+// array must outlive the vector and all of its copies, which share it.
+template <typename T>
+class MappedVector {
+public:
+    MappedVector() = default;
+
+    MappedVector(const MappedVector& other)
+        : values_(other.values_)
+        , data_(other.IsMapped() ? other.data_ : values_.data())
+        , size_(other.size_) {
+    }
+
+    MappedVector& operator=(const MappedVector& other) {
+        if (this != &other) {
+            MappedVector copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    // Moving a std::vector keeps its buffer, so data_ stays valid
+    MappedVector(MappedVector&& other) noexcept
+        : values_(std::move(other.values_))
+        , data_(other.data_)
+        , size_(other.size_) {
+        other.Clear();
+    }
+
+    MappedVector& operator=(MappedVector&& other) noexcept {
+        if (this != &other) {
+            values_ = std::move(other.values_);
+            data_ = other.data_;
+            size_ = other.size_;
+            other.Clear();
+        }
+        return *this;
+    }
+
+    static MappedVector Map(const T* data, size_t size) {
+        MappedVector vector;
+        vector.data_ = data;
+        vector.size_ = size;
+        return vector;
+    }
+
+    const T& operator[](size_t index) const {
+        return data_[index];
+    }
+
+    T& operator[](size_t index) {
+        Detach();
+        return values_[index];
+    }
+
+    const T* data() const {
+        return data_;
+    }
+
+    const T* begin() const {
+        return data_;
+    }
+
+    const T* end() const {
+        return data_ + size_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    void push_back(const T& value) {
+        Detach();
+        values_.push_back(value);
+        Sync();
+    }
+
+    void insert(const T* position, const T* first, const T* last) {
+        const size_t index = position - data_;
+        Detach();
+        values_.insert(values_.begin() + index, first, last);
+        Sync();
+    }
+
+    void resize(size_t size) {
+        Detach();
+        values_.resize(size);
+        Sync();
+    }
+
+    void reserve(size_t capacity) {
+        Detach();
+        values_.reserve(capacity);
+        Sync();
+    }
+
+private:
+    std::vector<T> values_;
+    const T* data_ = nullptr;
+    size_t size_ = 0;
+
+    bool IsMapped() const {
+        return data_ != values_.data();
+    }
+
+    void Detach() {
+        if (IsMapped()) {
+            values_.assign(data_, data_ + size_);
+            Sync();
+        }
+    }
+
+    void Sync() {
+        data_ = values_.data();
+        size_ = values_.size();
+    }
+
+    void Clear() {
+        values_.clear();
+        Sync();
+    }
+};
@@ -0,0 +1,243 @@
+#include "near_duplicates.h"
+
+#include <algorithm>
+#include <execution>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+using std::string_literals::operator""s;
+
+namespace {
+
+// The splitmix64 finalizer
+uint64_t Mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+constexpr int NO_DOCUMENT = -1;
+
+class DisjointSets {
+public:
+    explicit DisjointSets(size_t size)
+        : parents_(size)
+    {
+        std::iota(parents_.begin(), parents_.end(), 0);
+    }
+
+    uint32_t Find(uint32_t element) {
+        while (parents_[element] != element) {
+            parents_[element] = parents_[parents_[element]];
+            element = parents_[element];
+        }
+        return element;
+    }
+
+    void Unite(uint32_t lhs, uint32_t rhs) {
+        parents_[Find(lhs)] = Find(rhs);
+    }
+
+private:
+    std::vector<uint32_t> parents_;
+};
+
+}
+
+NearDuplicateDetector::NearDuplicateDetector(const SearchServer& search_server, const NearDuplicateOptions& options)
+    : search_server_(search_server)
+    , options_(options)
+    , hash_count_(options.band_count * options.rows_per_band)
+    , bands_(options.band_count)
+    , generation_(search_server.GetGeneration())
+    , internal_id_count_(static_cast<uint32_t>(search_server.internal_to_external_.size()))
+{
+    if (hash_count_ == 0) {
+        throw std::invalid_argument("Signatures need at least one band of one row"s);
+    }
+    // Multiply-shift hashes of a mixed term id, with fixed parameters so that
+    // signatures don't depend on the run
+    uint64_t seed = 0x2545F4914F6CDD1DULL;
+    for (size_t i = 0; i < hash_count_; ++i) {
+        hash_multipliers_.push_back(Mix(seed += 0x9E3779B97F4A7C15ULL) | 1);
+        hash_increments_.push_back(Mix(seed += 0x9E3779B97F4A7C15ULL));
+    }
+
+    std::vector<uint32_t> internal_ids;
+    for (uint32_t internal_id = 0; internal_id < internal_id_count_; ++internal_id) {
+        if (search_server_.IsLive(internal_id)) {
+            internal_ids.push_back(internal_id);
+        }
+    }
+    signatures_.resize(internal_ids.size() * hash_count_);
+    slot_ids_.resize(internal_ids.size());
+    slot_internal_ids_ = internal_ids;
+    std::vector<uint32_t> slots(internal_ids.size());
+    std::iota(slots.begin(), slots.end(), 0);
+    std::for_each(std::execution::par, slots.begin(), slots.end(), [&](uint32_t slot) {
+        const uint32_t internal_id = internal_ids[slot];
+        slot_ids_[slot] = ComputeSignature(internal_id, &signatures_[slot * hash_count_])
+            ? search_server_.internal_to_external_[internal_id] : NO_DOCUMENT;
+    });
+    for (const uint32_t slot : slots) {
+        if (slot_ids_[slot] == NO_DOCUMENT) {
+            free_slots_.push_back(slot);
+        }
+        else {
+            ++document_count_;
+        }
+    }
+
+    std::vector<size_t> band_positions(bands_.size());
+    std::iota(band_positions.begin(), band_positions.end(), 0);
+    std::for_each(std::execution::par, band_positions.begin(), band_positions.end(), [&](size_t band) {
+        for (const uint32_t slot : slots) {
+            if (slot_ids_[slot] != NO_DOCUMENT) {
+                bands_[band][HashBand(&signatures_[slot * hash_count_], band)].push_back(slot);
+            }
+        }
+    });
+}
+
+void NearDuplicateDetector::Update() {
+    if (search_server_.GetGeneration() == generation_) {
+        return;
+    }
+    generation_ = search_server_.GetGeneration();
+    for (uint32_t slot = 0; slot < slot_ids_.size(); ++slot) {
+        if (slot_ids_[slot] != NO_DOCUMENT && !search_server_.IsLive(slot_internal_ids_[slot])) {
+            RemoveSlot(slot);
+        }
+    }
+    const uint32_t internal_id_count = static_cast<uint32_t>(search_server_.internal_to_external_.size());
+    for (uint32_t internal_id = internal_id_count_; internal_id < internal_id_count; ++internal_id) {
+        if (search_server_.IsLive(internal_id)) {
+            AddSlot(internal_id);
+        }
+    }
+    internal_id_count_ = internal_id_count;
+}
+
+std::vector<std::vector<int>> NearDuplicateDetector::FindClusters() {
+    size_t skipped_comparison_count = 0;
+    return FindClusters(skipped_comparison_count);
+}
+
+std::vector<std::vector<int>> NearDuplicateDetector::FindClusters(size_t& skipped_comparison_count) {
+    Update();
+    const size_t max_comparisons = options_.max_bucket_comparisons > 0
+        ? options_.max_bucket_comparisons : std::numeric_limits<size_t>::max();
+    skipped_comparison_count = 0;
+    DisjointSets clusters(slot_ids_.size());
+    for (const auto& buckets : bands_) {
+        for (const auto& [band_hash, slots] : buckets) {
+            for (size_t i = 1; i < slots.size(); ++i) {
+                const size_t comparison_count = std::min(i, max_comparisons);
+                skipped_comparison_count += i - comparison_count;
+                for (size_t j = i - comparison_count; j < i; ++j) {
+                    if (clusters.Find(slots[i]) != clusters.Find(slots[j])
+                        && EstimateSimilarity(slots[i], slots[j]) >= options_.min_similarity) {
+                        clusters.Unite(slots[i], slots[j]);
+                    }
+                }
+            }
+        }
+    }
+
+    std::unordered_map<uint32_t, std::vector<int>> groups;
+    for (uint32_t slot = 0; slot < slot_ids_.size(); ++slot) {
+        if (slot_ids_[slot] != NO_DOCUMENT) {
+            groups[clusters.Find(slot)].push_back(slot_ids_[slot]);
+        }
+    }
+    std::vector<std::vector<int>> result;
+    for (auto& [root, document_ids] : groups) {
+        if (document_ids.size() > 1) {
+            std::sort(document_ids.begin(), document_ids.end());
+            result.push_back(std::move(document_ids));
+        }
+    }
+    std::sort(result.begin(), result.end(), [](const std::vector<int>& lhs, const std::vector<int>& rhs) {
+        return lhs.front() < rhs.front();
+    });
+    return result;
+}
+
+size_t NearDuplicateDetector::GetDocumentCount() const {
+    return document_count_;
+}
+
+void NearDuplicateDetector::AddSlot(uint32_t internal_id) {
+    uint32_t slot;
+    if (!free_slots_.empty()) {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+    }
+    else {
+        slot = static_cast<uint32_t>(slot_ids_.size());
+        slot_ids_.push_back(NO_DOCUMENT);
+        slot_internal_ids_.push_back(internal_id);
+        signatures_.resize(signatures_.size() + hash_count_);
+    }
+    uint32_t* signature = &signatures_[slot * hash_count_];
+    if (!ComputeSignature(internal_id, signature)) {
+        free_slots_.push_back(slot);
+        return;
+    }
+    slot_ids_[slot] = search_server_.internal_to_external_[internal_id];
+    slot_internal_ids_[slot] = internal_id;
+    ++document_count_;
+    for (size_t band = 0; band < bands_.size(); ++band) {
+        bands_[band][HashBand(signature, band)].push_back(slot);
+    }
+}
+
+void NearDuplicateDetector::RemoveSlot(uint32_t slot) {
+    const uint32_t* signature = &signatures_[slot * hash_count_];
+    for (size_t band = 0; band < bands_.size(); ++band) {
+        const auto bucket = bands_[band].find(HashBand(signature, band));
+        std::vector<uint32_t>& slots = bucket->second;
+        slots.erase(std::find(slots.begin(), slots.end(), slot));
+        if (slots.empty()) {
+            bands_[band].erase(bucket);
+        }
+    }
+    --document_count_;
+    slot_ids_[slot] = NO_DOCUMENT;
+    free_slots_.push_back(slot);
+}
+
+bool NearDuplicateDetector::ComputeSignature(uint32_t internal_id, uint32_t* signature) const {
+    const ForwardIndex::Terms term_counts = search_server_.forward_index_.GetTerms(internal_id);
+    if (term_counts.empty()) {
+        return false;
+    }
+    std::fill(signature, signature + hash_count_, std::numeric_limits<uint32_t>::max());
+    for (const auto [term_id, term_count] : term_counts) {
+        const uint64_t key = Mix(term_id + 1ULL);
+        for (size_t i = 0; i < hash_count_; ++i) {
+            const uint32_t hash = static_cast<uint32_t>((key * hash_multipliers_[i] + hash_increments_[i]) >> 32);
+            signature[i] = std::min(signature[i], hash);
+        }
+    }
+    return true;
+}
+
+uint64_t NearDuplicateDetector::HashBand(const uint32_t* signature, size_t band) const {
+    uint64_t hash = band;
+    for (size_t row = band * options_.rows_per_band; row < (band + 1) * options_.rows_per_band; ++row) {
+        hash = Mix(hash ^ signature[row]);
+    }
+    return hash;
+}
+
+double NearDuplicateDetector::EstimateSimilarity(uint32_t lhs_slot, uint32_t rhs_slot) const {
+    const uint32_t* lhs = &signatures_[lhs_slot * hash_count_];
+    const uint32_t* rhs = &signatures_[rhs_slot * hash_count_];
+    size_t equal_count = 0;
+    for (size_t i = 0; i < hash_count_; ++i) {
+        equal_count += lhs[i] == rhs[i] ? 1 : 0;
+    }
+    return static_cast<double>(equal_count) / hash_count_;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "search_server.h"
+
+struct NearDuplicateOptions {
+    // Bands of rows_per_band hashes make up a signature. Two documents with
+    // Jaccard similarity s share at least one band with probability
+    // 1 - (1 - s^rows_per_band)^band_count; the defaults catch 0.8 almost
+    // surely and 0.5 only about half the time.
+    size_t band_count = 16;
+    size_t rows_per_band = 4;
+    // Pairs of candidates whose signatures agree on at least this fraction
+    // of hashes, an estimate of their Jaccard similarity, are clustered
+    double min_similarity = 0.8;
+    // Earlier members of a bucket that each member is compared with, or 0
+    // for all of them. A bucket full of copies of one document then costs
+    // linear time, not quadratic, but two documents that share only such
+    // buckets, far apart in each, are never compared; FindClusters counts
+    // the pairs it skips.
+    size_t max_bucket_comparisons = 16;
+};
+
+// MinHash signatures of the word sets of a server's documents, bucketed by
+// band for locality-sensitive hashing: only documents that share a band
+// are ever compared, so finding clusters takes time roughly linear in the
+// number of documents. Documents without words are left out.
+// The detector follows the server by internal id, which the server never
+// reuses: Update signs the documents added since the last update and drops
+// the removed ones, so it must not run concurrently with changes to the
+// server.
+class NearDuplicateDetector {
+public:
+    // Signatures of every document of search_server, computed in parallel
+    explicit NearDuplicateDetector(const SearchServer& search_server, const NearDuplicateOptions& options = {});
+
+    // Catches up with the documents added to and removed from the server
+    // since the last update; does nothing if the server hasn't changed
+    void Update();
+
+    // Groups of two or more documents, each linked to another of its group
+    // by the similarity threshold, after an Update. Ids in a group and
+    // groups by their first id are ascending.
+    std::vector<std::vector<int>> FindClusters();
+
+    // Same, and sets skipped_comparison_count to the candidate pairs left
+    // out by max_bucket_comparisons, once for each band they share
+    std::vector<std::vector<int>> FindClusters(size_t& skipped_comparison_count);
+
+    // As of the last update
+    size_t GetDocumentCount() const;
+
+private:
+    const SearchServer& search_server_;
+    const NearDuplicateOptions options_;
+    const size_t hash_count_;
+    // Multipliers and increments of the hash functions
+    std::vector<uint64_t> hash_multipliers_;
+    std::vector<uint64_t> hash_increments_;
+
+    // Signature of slot i is signatures_[i * hash_count_, (i + 1) * hash_count_)
+    std::vector<uint32_t> signatures_;
+    std::vector<int> slot_ids_;
+    std::vector<uint32_t> slot_internal_ids_;
+    std::vector<uint32_t> free_slots_;
+    size_t document_count_ = 0;
+    // Per band: hash of the band's rows -> slots
+    std::vector<std::unordered_map<uint64_t, std::vector<uint32_t>>> bands_;
+    // Server generation of the last update, and its internal id count then
+    uint64_t generation_;
+    uint32_t internal_id_count_;
+
+    void AddSlot(uint32_t internal_id);
+
+    void RemoveSlot(uint32_t slot);
+
+    // Hashes of the document's terms, or false if it has none
+    bool ComputeSignature(uint32_t internal_id, uint32_t* signature) const;
+
+    uint64_t HashBand(const uint32_t* signature, size_t band) const;
+
+    double EstimateSimilarity(uint32_t lhs_slot, uint32_t rhs_slot) const;
+};
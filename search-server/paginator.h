@@ -2,6 +2,7 @@
 #include <vector>
 #include <ostream>
 #include <cassert>
+#include <iterator>
 
 template <typename Iterator>
 class IteratorRange {
@@ -9,7 +10,7 @@ public:
     IteratorRange() = default;
 
     IteratorRange(Iterator begin, Iterator end)
-        : first_(begin), last_(end), size_(distance(first_, last_))
+        : first_(begin), last_(end), size_(std::distance(first_, last_))
     {
     }
 
@@ -37,9 +38,9 @@ public:
     Paginator(Iterator begin, Iterator end, int size) 
     {
         assert(end >= begin && size > 0);
-        for (int left = distance(begin, end); left > 0;) {
+        for (int left = std::distance(begin, end); left > 0;) {
             const size_t current_page_size = std::min(size, left);
-            const Iterator current_page_end = next(begin, current_page_size);
+            const Iterator current_page_end = std::next(begin, current_page_size);
             pages_.push_back({ begin, current_page_end });
             left -= current_page_size;
             begin = current_page_end;
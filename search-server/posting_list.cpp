@@ -0,0 +1,358 @@
+#include "posting_list.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+void WriteVarint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+// Blocks of a mapped file are only checked here, as they are decoded, so a
+// varint running past the end of its block means the file is corrupted
+uint32_t ReadVarint(const uint8_t*& in, const uint8_t* end) {
+    // Most deltas and counts take one byte
+    if (in != end && *in < 0x80) {
+        return *in++;
+    }
+    uint32_t value = 0;
+    for (int shift = 0; in != end && shift < 32; shift += 7) {
+        const uint8_t byte = *in++;
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Posting list is corrupted");
+}
+
+}
+
+void PostingList::Add(int document_id, uint32_t term_count) {
+    const size_t block_count = GetBlockCount();
+    const bool after_blocks = block_count == 0 || GetBlocks()[block_count - 1].last_document_id < document_id;
+    if (after_blocks && (tail_document_ids_.empty() || tail_document_ids_.back() < document_id)) {
+        tail_document_ids_.push_back(document_id);
+        tail_term_counts_.push_back(term_count);
+    }
+    else if (after_blocks) {
+        const auto it = std::lower_bound(tail_document_ids_.begin(), tail_document_ids_.end(), document_id);
+        const auto index = std::distance(tail_document_ids_.begin(), it);
+        if (*it == document_id) {
+            tail_term_counts_[index] = term_count;
+            return;
+        }
+        tail_document_ids_.insert(it, document_id);
+        tail_term_counts_.insert(tail_term_counts_.begin() + index, term_count);
+    }
+    else {
+        // Inside the compressed part, which only happens for out-of-order ids
+        std::vector<int> document_ids;
+        std::vector<uint32_t> term_counts;
+        Decode(document_ids, term_counts);
+        const auto it = std::lower_bound(document_ids.begin(), document_ids.end(), document_id);
+        const auto index = std::distance(document_ids.begin(), it);
+        if (it != document_ids.end() && *it == document_id) {
+            term_counts[index] = term_count;
+        }
+        else {
+            document_ids.insert(it, document_id);
+            term_counts.insert(term_counts.begin() + index, term_count);
+        }
+        Rebuild(std::move(document_ids), std::move(term_counts));
+        return;
+    }
+    if (tail_document_ids_.size() == BLOCK_SIZE) {
+        SealTail();
+    }
+}
+
+void PostingList::Remove(int document_id) {
+    const auto tail_it = std::lower_bound(tail_document_ids_.begin(), tail_document_ids_.end(), document_id);
+    if (tail_it != tail_document_ids_.end() && *tail_it == document_id) {
+        tail_term_counts_.erase(tail_term_counts_.begin() + std::distance(tail_document_ids_.begin(), tail_it));
+        tail_document_ids_.erase(tail_it);
+        return;
+    }
+    if (!Contains(document_id)) {
+        return;
+    }
+    tombstones_.insert(std::lower_bound(tombstones_.begin(), tombstones_.end(), document_id), document_id);
+    if (tombstones_.size() * 2 > GetPostingCount()) {
+        Compact();
+    }
+}
+
+void PostingList::Compact() {
+    if (tombstones_.empty()) {
+        return;
+    }
+    std::vector<int> document_ids;
+    std::vector<uint32_t> term_counts;
+    Decode(document_ids, term_counts);
+    Rebuild(std::move(document_ids), std::move(term_counts));
+}
+
+bool PostingList::Contains(int document_id) const {
+    if (std::binary_search(tail_document_ids_.begin(), tail_document_ids_.end(), document_id)) {
+        return true;
+    }
+    const BlockHeader* blocks = GetBlocks();
+    const BlockHeader* header = std::partition_point(blocks, blocks + GetBlockCount(),
+        [document_id](const BlockHeader& block) { return block.last_document_id < document_id; });
+    if (header == blocks + GetBlockCount() || IsTombstone(document_id)) {
+        return false;
+    }
+    int document_ids[BLOCK_SIZE];
+    uint32_t term_counts[BLOCK_SIZE];
+    const size_t count = DecodeBlock(header - blocks, document_ids, term_counts);
+    return std::binary_search(document_ids, document_ids + count, document_id);
+}
+
+size_t PostingList::size() const {
+    return GetPostingCount() - tombstones_.size();
+}
+
+bool PostingList::empty() const {
+    return size() == 0;
+}
+
+size_t PostingList::GetMemoryUsage() const {
+    return sizeof(*this)
+        + blocks_.capacity() * sizeof(BlockHeader)
+        + data_.capacity() * sizeof(uint8_t)
+        + tail_document_ids_.capacity() * sizeof(int)
+        + tail_term_counts_.capacity() * sizeof(uint32_t)
+        + tombstones_.capacity() * sizeof(int);
+}
+
+void PostingList::Serialize(IndexFileWriter& writer) const {
+    if (!tombstones_.empty()) {
+        PostingList compacted(*this);
+        compacted.Compact();
+        compacted.Serialize(writer);
+        return;
+    }
+    const size_t block_count = GetBlockCount();
+    const size_t data_size = mapped_blocks_ != nullptr ? mapped_data_size_ : data_.size();
+    const uint32_t sizes[] = { static_cast<uint32_t>(block_count), static_cast<uint32_t>(tail_document_ids_.size()),
+        static_cast<uint32_t>(data_size), 0 };
+    writer.Write(sizes, sizeof(sizes));
+    writer.Write(GetBlocks(), block_count * sizeof(BlockHeader));
+    writer.Write(tail_document_ids_.data(), tail_document_ids_.size() * sizeof(int));
+    writer.Write(tail_term_counts_.data(), tail_term_counts_.size() * sizeof(uint32_t));
+    writer.Write(mapped_blocks_ != nullptr ? mapped_data_ : data_.data(), data_size);
+    writer.Align();
+}
+
+PostingList PostingList::Map(const uint8_t* bytes, size_t size) {
+    uint32_t sizes[4];
+    if (size < sizeof(sizes)) {
+        throw std::runtime_error("Posting list is truncated");
+    }
+    std::memcpy(sizes, bytes, sizeof(sizes));
+    const size_t block_count = sizes[0];
+    const size_t tail_count = sizes[1];
+    const size_t data_size = sizes[2];
+    if (tail_count >= BLOCK_SIZE
+        || sizeof(sizes) + block_count * sizeof(BlockHeader) + tail_count * (sizeof(int) + sizeof(uint32_t)) + data_size > size) {
+        throw std::runtime_error("Posting list is truncated");
+    }
+    PostingList list;
+    const uint8_t* position = bytes + sizeof(sizes);
+    list.mapped_blocks_ = reinterpret_cast<const BlockHeader*>(position);
+    list.mapped_block_count_ = block_count;
+    position += block_count * sizeof(BlockHeader);
+    list.tail_document_ids_.resize(tail_count);
+    list.tail_term_counts_.resize(tail_count);
+    std::memcpy(list.tail_document_ids_.data(), position, tail_count * sizeof(int));
+    position += tail_count * sizeof(int);
+    std::memcpy(list.tail_term_counts_.data(), position, tail_count * sizeof(uint32_t));
+    position += tail_count * sizeof(uint32_t);
+    list.mapped_data_ = position;
+    list.mapped_data_size_ = data_size;
+    return list;
+}
+
+size_t PostingList::GetPostingCount() const {
+    return GetBlockCount() * BLOCK_SIZE + tail_document_ids_.size();
+}
+
+const PostingList::BlockHeader* PostingList::GetBlocks() const {
+    return mapped_blocks_ != nullptr ? mapped_blocks_ : blocks_.data();
+}
+
+size_t PostingList::GetBlockCount() const {
+    return mapped_blocks_ != nullptr ? mapped_block_count_ : blocks_.size();
+}
+
+void PostingList::Detach() {
+    if (mapped_blocks_ == nullptr) {
+        return;
+    }
+    blocks_.assign(mapped_blocks_, mapped_blocks_ + mapped_block_count_);
+    data_.assign(mapped_data_, mapped_data_ + mapped_data_size_);
+    mapped_blocks_ = nullptr;
+    mapped_block_count_ = 0;
+    mapped_data_ = nullptr;
+    mapped_data_size_ = 0;
+}
+
+int PostingList::GetBlockBase(size_t block) const {
+    return block == 0 ? -1 : GetBlocks()[block - 1].last_document_id;
+}
+
+size_t PostingList::DecodeBlock(size_t block, int* document_ids, uint32_t* term_counts) const {
+    const uint8_t* data = mapped_blocks_ != nullptr ? mapped_data_ : data_.data();
+    const size_t data_size = mapped_blocks_ != nullptr ? mapped_data_size_ : data_.size();
+    // A block ends where the next one starts
+    const size_t begin = GetBlocks()[block].offset;
+    const size_t end = block + 1 < GetBlockCount() ? GetBlocks()[block + 1].offset : data_size;
+    if (begin > end || end > data_size) {
+        throw std::runtime_error("Posting list is corrupted");
+    }
+    const uint8_t* in = data + begin;
+    int document_id = GetBlockBase(block);
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        document_id += static_cast<int>(ReadVarint(in, data + end));
+        document_ids[i] = document_id;
+    }
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        term_counts[i] = ReadVarint(in, data + end);
+    }
+    return BLOCK_SIZE;
+}
+
+bool PostingList::IsTombstone(int document_id) const {
+    return std::binary_search(tombstones_.begin(), tombstones_.end(), document_id);
+}
+
+void PostingList::SealTail() {
+    Detach();
+    const int base = blocks_.empty() ? -1 : blocks_.back().last_document_id;
+    blocks_.push_back({ tail_document_ids_.back(), static_cast<uint32_t>(data_.size()) });
+    int previous = base;
+    for (const int document_id : tail_document_ids_) {
+        WriteVarint(data_, static_cast<uint32_t>(document_id - previous));
+        previous = document_id;
+    }
+    for (const uint32_t term_count : tail_term_counts_) {
+        WriteVarint(data_, term_count);
+    }
+    tail_document_ids_.clear();
+    tail_term_counts_.clear();
+}
+
+void PostingList::Rebuild(std::vector<int> document_ids, std::vector<uint32_t> term_counts) {
+    mapped_blocks_ = nullptr;
+    mapped_block_count_ = 0;
+    mapped_data_ = nullptr;
+    mapped_data_size_ = 0;
+    blocks_.clear();
+    data_.clear();
+    tombstones_.clear();
+    tail_document_ids_.clear();
+    tail_term_counts_.clear();
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        tail_document_ids_.push_back(document_ids[i]);
+        tail_term_counts_.push_back(term_counts[i]);
+        if (tail_document_ids_.size() == BLOCK_SIZE) {
+            SealTail();
+        }
+    }
+    blocks_.shrink_to_fit();
+    data_.shrink_to_fit();
+    tombstones_.shrink_to_fit();
+}
+
+void PostingList::Decode(std::vector<int>& document_ids, std::vector<uint32_t>& term_counts) const {
+    document_ids.reserve(size());
+    term_counts.reserve(size());
+    ForEach([&](int document_id, uint32_t term_count) {
+        document_ids.push_back(document_id);
+        term_counts.push_back(term_count);
+    });
+}
+
+PostingList::Cursor::Cursor(const PostingList& list)
+    : list_(&list)
+{
+    LoadBlock();
+    SkipTombstones();
+}
+
+bool PostingList::Cursor::AtEnd() const {
+    return block_ > list_->GetBlockCount();
+}
+
+int PostingList::Cursor::GetDocumentId() const {
+    return block_ < list_->GetBlockCount() ? decoded_document_ids_[position_] : list_->tail_document_ids_[position_];
+}
+
+uint32_t PostingList::Cursor::GetTermCount() const {
+    return block_ < list_->GetBlockCount() ? decoded_term_counts_[position_] : list_->tail_term_counts_[position_];
+}
+
+void PostingList::Cursor::Next() {
+    if (++position_ == count_) {
+        ++block_;
+        LoadBlock();
+    }
+    SkipTombstones();
+}
+
+void PostingList::Cursor::SkipTo(int document_id) {
+    if (AtEnd() || GetDocumentId() >= document_id) {
+        return;
+    }
+    const BlockHeader* blocks = list_->GetBlocks();
+    const size_t block_count = list_->GetBlockCount();
+    if (block_ < block_count && blocks[block_].last_document_id < document_id) {
+        const BlockHeader* header = std::partition_point(blocks + block_ + 1, blocks + block_count,
+            [document_id](const BlockHeader& block) { return block.last_document_id < document_id; });
+        block_ = header - blocks;
+        LoadBlock();
+    }
+    while (!AtEnd() && GetDocumentId() < document_id) {
+        Next();
+    }
+    SkipTombstones();
+}
+
+void PostingList::Cursor::LoadBlock() {
+    position_ = 0;
+    const size_t block_count = list_->GetBlockCount();
+    if (block_ < block_count) {
+        count_ = list_->DecodeBlock(block_, decoded_document_ids_, decoded_term_counts_);
+        return;
+    }
+    count_ = list_->tail_document_ids_.size();
+    if (block_ == block_count && count_ == 0) {
+        block_ = block_count + 1;
+    }
+}
+
+void PostingList::Cursor::SkipTombstones() {
+    const auto& tombstones = list_->tombstones_;
+    while (!AtEnd() && block_ < list_->GetBlockCount() && tombstone_ < tombstones.size()) {
+        const int document_id = GetDocumentId();
+        while (tombstone_ < tombstones.size() && tombstones[tombstone_] < document_id) {
+            ++tombstone_;
+        }
+        if (tombstone_ == tombstones.size() || tombstones[tombstone_] != document_id) {
+            return;
+        }
+        if (++position_ == count_) {
+            ++block_;
+            LoadBlock();
+        }
+    }
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "index_file.h"
+
+// Postings of one term, sorted by document id. Full blocks of BLOCK_SIZE
+// postings are stored compressed: document id deltas followed by term
+// occurrence counts, both as varints. Each block header keeps the largest
+// document id of the block, so cursors can skip blocks without decoding
+// them. The newest postings stay uncompressed in a tail until it fills up.
+// Removed documents are tombstoned and dropped by Compact, which runs
+// once they outnumber live postings. A list read from an index file keeps
+// its blocks in the mapped file until it is first changed.
+class PostingList {
+public:
+    static constexpr size_t BLOCK_SIZE = 128;
+
+    class Cursor;
+
+    void Add(int document_id, uint32_t term_count);
+
+    void Remove(int document_id);
+
+    void Compact();
+
+    bool Contains(int document_id) const;
+
+    // Number of live postings
+    size_t size() const;
+
+    bool empty() const;
+
+    size_t GetMemoryUsage() const;
+
+    template <typename Function>
+    void ForEach(Function function) const;
+
+    // Writes the live postings in the layout Map reads
+    void Serialize(IndexFileWriter& writer) const;
+
+    // Reads a list written by Serialize. The blocks aren't copied, so the
+    // bytes must outlive the list and all of its copies. Blocks are checked
+    // as they are decoded: reading a corrupted one throws std::runtime_error.
+    static PostingList Map(const uint8_t* bytes, size_t size);
+
+private:
+    struct BlockHeader {
+        int last_document_id;
+        uint32_t offset;
+    };
+
+    std::vector<BlockHeader> blocks_;
+    std::vector<uint8_t> data_;
+    std::vector<int> tail_document_ids_;
+    std::vector<uint32_t> tail_term_counts_;
+    // Sorted ids of removed documents that still sit in compressed blocks
+    std::vector<int> tombstones_;
+    // Used instead of blocks_ and data_ while the blocks are in a mapped file
+    const BlockHeader* mapped_blocks_ = nullptr;
+    size_t mapped_block_count_ = 0;
+    const uint8_t* mapped_data_ = nullptr;
+    size_t mapped_data_size_ = 0;
+
+    const BlockHeader* GetBlocks() const;
+
+    size_t GetBlockCount() const;
+
+    // Copies mapped blocks into blocks_ and data_ before they are changed
+    void Detach();
+
+    size_t GetPostingCount() const;
+
+    int GetBlockBase(size_t block) const;
+
+    // Returns the number of postings written
+    size_t DecodeBlock(size_t block, int* document_ids, uint32_t* term_counts) const;
+
+    bool IsTombstone(int document_id) const;
+
+    void SealTail();
+
+    void Rebuild(std::vector<int> document_ids, std::vector<uint32_t> term_counts);
+
+    void Decode(std::vector<int>& document_ids, std::vector<uint32_t>& term_counts) const;
+};
+
+class PostingList::Cursor {
+public:
+    explicit Cursor(const PostingList& list);
+
+    bool AtEnd() const;
+
+    int GetDocumentId() const;
+
+    uint32_t GetTermCount() const;
+
+    void Next();
+
+    // Moves to the first posting with document id not less than the given one
+    void SkipTo(int document_id);
+
+private:
+    const PostingList* list_;
+    size_t block_ = 0;
+    size_t position_ = 0;
+    size_t count_ = 0;
+    size_t tombstone_ = 0;
+    int decoded_document_ids_[BLOCK_SIZE];
+    uint32_t decoded_term_counts_[BLOCK_SIZE];
+
+    void LoadBlock();
+
+    void SkipTombstones();
+};
+
+template <typename Function>
+void PostingList::ForEach(Function function) const {
+    int document_ids[BLOCK_SIZE];
+    uint32_t term_counts[BLOCK_SIZE];
+    auto tombstone = tombstones_.begin();
+    for (size_t block = 0; block < GetBlockCount(); ++block) {
+        const size_t count = DecodeBlock(block, document_ids, term_counts);
+        for (size_t i = 0; i < count; ++i) {
+            if (tombstone != tombstones_.end() && *tombstone == document_ids[i]) {
+                ++tombstone;
+                continue;
+            }
+            function(document_ids[i], term_counts[i]);
+        }
+    }
+    for (size_t i = 0; i < tail_document_ids_.size(); ++i) {
+        function(tail_document_ids_[i], tail_term_counts_[i]);
+    }
+}
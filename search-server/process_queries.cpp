@@ -4,25 +4,37 @@ std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
 
+    return QueryBatch(search_server).Process(queries);
+}
+
+std::vector<std::vector<Document>> ProcessQueries(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries,
+    QueryBatchStatistics& statistics) {
+
+    QueryBatch batch(search_server);
+    auto result = batch.Process(queries);
+    statistics = batch.GetStatistics();
+    return result;
+}
+
+std::vector<std::vector<Document>> ProcessQueries(
+    QueryCache& query_cache,
+    const std::vector<std::string>& queries) {
+
     std::vector<std::vector<Document>> result(queries.size());
     std::transform(std::execution::par,
         queries.begin(), queries.end(),
         result.begin(),
-        [&search_server](const std::string buff) {
-            return search_server.FindTopDocuments(buff);
+        [&query_cache](const std::string& query) {
+            return query_cache.FindTopDocuments(query);
         });
     return result;
 }
 
-std::list<Document> ProcessQueriesJoined(
+JoinedDocuments ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
 
-    std::list<Document> result;
-    for (auto step : ProcessQueries(search_server, queries)) {
-        for (auto doc : step) {
-            result.push_back(doc);
-        }
-    }
-    return result;
+    return QueryBatch(search_server).ProcessJoined(queries);
 }
\ No newline at end of file
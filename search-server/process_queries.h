@@ -1,17 +1,31 @@
 #pragma once
 #include"document.h"
 #include"search_server.h"
+#include"query_cache.h"
+#include"query_batch.h"
 
 #include <vector>
 #include <execution>
 #include <algorithm>
 #include <string>
-#include <list>
 
+// Runs the queries as one QueryBatch
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
-std::list<Document> ProcessQueriesJoined(
+// Same, and reports the throughput and latencies of the batch
+std::vector<std::vector<Document>> ProcessQueries(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries,
+    QueryBatchStatistics& statistics);
+
+// Answers repeated queries from the cache
+std::vector<std::vector<Document>> ProcessQueries(
+    QueryCache& query_cache,
+    const std::vector<std::string>& queries);
+
+// Results of all the queries in one buffer, in query order
+JoinedDocuments ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
\ No newline at end of file
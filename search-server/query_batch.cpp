@@ -0,0 +1,357 @@
+#include "query_batch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+using std::string_literals::operator""s;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Tasks of one thread: it takes them from the front, where the most
+// expensive ones are, and other threads steal from the back
+struct alignas(64) TaskQueue {
+    std::mutex mutex;
+    std::deque<size_t> tasks;
+};
+
+std::optional<size_t> PopTask(TaskQueue& queue, bool from_front) {
+    std::lock_guard guard(queue.mutex);
+    if (queue.tasks.empty()) {
+        return std::nullopt;
+    }
+    const size_t task = from_front ? queue.tasks.front() : queue.tasks.back();
+    if (from_front) {
+        queue.tasks.pop_front();
+    }
+    else {
+        queue.tasks.pop_back();
+    }
+    return task;
+}
+
+// Threads that run one batch of tasks at a time and wait for the next one
+// in between, so that a batch doesn't pay for starting threads. The thread
+// that runs a batch takes part in it as thread 0.
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t worker_count)
+        : queues_(worker_count + 1)
+    {
+        for (size_t i = 1; i <= worker_count; ++i) {
+            threads_.emplace_back([this, i] { RunWorker(i); });
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool() {
+        {
+            std::lock_guard guard(mutex_);
+            stopping_ = true;
+        }
+        wakeup_.notify_all();
+        for (std::thread& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    // The calling thread included
+    size_t GetThreadCount() const {
+        return queues_.size();
+    }
+
+    // Calls run(task) for every task on thread_count threads, at most
+    // GetThreadCount(). Tasks are dealt to the queues round robin in the
+    // given order. No task adds more, so a thread that finds every queue
+    // empty is done. Returns false, running nothing, while another batch
+    // holds the pool.
+    bool TryRun(const std::vector<size_t>& tasks, size_t thread_count, const std::function<void(size_t)>& run) {
+        std::unique_lock batch_lock(batch_mutex_, std::try_to_lock);
+        if (!batch_lock.owns_lock()) {
+            return false;
+        }
+        thread_count = std::clamp<size_t>(thread_count, 1, queues_.size());
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            queues_[i % thread_count].tasks.push_back(tasks[i]);
+        }
+        {
+            std::lock_guard guard(mutex_);
+            run_ = &run;
+            thread_count_ = thread_count;
+            busy_count_ = threads_.size();
+            ++batch_;
+        }
+        wakeup_.notify_all();
+        Work(0);
+
+        std::unique_lock lock(mutex_);
+        done_.wait(lock, [this] { return busy_count_ == 0; });
+        run_ = nullptr;
+        // A thread that failed left its tasks behind unless others stole them
+        for (TaskQueue& queue : queues_) {
+            queue.tasks.clear();
+        }
+        if (error_) {
+            std::exception_ptr error = std::exchange(error_, nullptr);
+            std::rethrow_exception(error);
+        }
+        return true;
+    }
+
+private:
+    std::vector<TaskQueue> queues_;
+    // Held by the batch being run
+    std::mutex batch_mutex_;
+    // Guards everything below
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::condition_variable done_;
+    const std::function<void(size_t)>* run_ = nullptr;
+    size_t thread_count_ = 0;
+    uint64_t batch_ = 0;
+    // Workers yet to finish the current batch
+    size_t busy_count_ = 0;
+    bool stopping_ = false;
+    std::exception_ptr error_;
+    std::vector<std::thread> threads_;
+
+    void RunWorker(size_t self) {
+        uint64_t last_batch = 0;
+        std::unique_lock lock(mutex_);
+        while (true) {
+            wakeup_.wait(lock, [this, last_batch] { return stopping_ || batch_ != last_batch; });
+            if (stopping_) {
+                return;
+            }
+            last_batch = batch_;
+            lock.unlock();
+            Work(self);
+            lock.lock();
+            if (--busy_count_ == 0) {
+                done_.notify_one();
+            }
+        }
+    }
+
+    void Work(size_t self) {
+        if (self >= thread_count_) {
+            return;
+        }
+        try {
+            while (true) {
+                std::optional<size_t> task = PopTask(queues_[self], true);
+                for (size_t i = 1; !task && i < thread_count_; ++i) {
+                    task = PopTask(queues_[(self + i) % thread_count_], false);
+                }
+                if (!task) {
+                    return;
+                }
+                (*run_)(*task);
+            }
+        } catch (...) {
+            std::lock_guard guard(mutex_);
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+        }
+    }
+};
+
+// Shared by every QueryBatch, with a thread per core
+WorkerPool& GetWorkerPool() {
+    static WorkerPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+// Nearest-rank percentile of sorted values
+double GetPercentile(const std::vector<double>& sorted_values, double percentile) {
+    if (sorted_values.empty()) {
+        return 0.0;
+    }
+    const size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * sorted_values.size()));
+    return sorted_values[std::clamp<size_t>(rank, 1, sorted_values.size()) - 1];
+}
+
+}
+
+double QueryBatchStatistics::GetQueriesPerSecond() const {
+    return seconds > 0.0 ? query_count / seconds : 0.0;
+}
+
+std::ostream& operator<<(std::ostream& out, const QueryBatchStatistics& statistics) {
+    return out << statistics.query_count << " queries ("s << statistics.distinct_query_count << " distinct) in "s
+        << statistics.seconds << " s: "s << statistics.GetQueriesPerSecond() << " QPS, latency p50 "s
+        << statistics.latency_p50 << " ms, p90 "s << statistics.latency_p90 << " ms, p99 "s
+        << statistics.latency_p99 << " ms, max "s << statistics.latency_max << " ms"s;
+}
+
+QueryBatch::QueryBatch(const SearchServer& search_server, size_t thread_count)
+    : search_server_(search_server)
+    , thread_count_(thread_count > 0 ? thread_count : std::max(1u, std::thread::hardware_concurrency()))
+{
+}
+
+std::vector<std::vector<Document>> QueryBatch::Process(const std::vector<std::string>& queries) {
+    const auto start = Clock::now();
+    std::vector<std::vector<Document>> results(queries.size());
+    std::vector<size_t> first_indexes;
+    ScoreDistinct(queries, first_indexes, [&results](size_t query_index, TopDocuments& top) {
+        top.Extract(results[query_index]);
+    });
+    for (size_t i = 0; i < queries.size(); ++i) {
+        if (first_indexes[i] != i) {
+            results[i] = results[first_indexes[i]];
+        }
+    }
+    statistics_.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return results;
+}
+
+JoinedDocuments QueryBatch::ProcessJoined(const std::vector<std::string>& queries) {
+    const auto start = Clock::now();
+    // Every query first gets a slice of room for a full top, at index * MAX_RESULT_DOCUMENT_COUNT,
+    // and the workers extract their tops straight into the slices of the queries they score
+    std::vector<Document> documents(queries.size() * MAX_RESULT_DOCUMENT_COUNT);
+    std::vector<size_t> sizes(queries.size());
+    std::vector<size_t> first_indexes;
+    ScoreDistinct(queries, first_indexes, [&documents, &sizes](size_t query_index, TopDocuments& top) {
+        sizes[query_index] = top.Extract(documents.data() + query_index * MAX_RESULT_DOCUMENT_COUNT);
+    });
+
+    // Then the slices close up in query order. A slice only ever moves
+    // towards the front, and a repeat copies the slice of its first
+    // query, which is already in place.
+    std::vector<size_t> offsets(queries.size() + 1);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const size_t first_index = first_indexes[i];
+        const size_t size = sizes[first_index];
+        const Document* source = documents.data() + (first_index == i ? i * MAX_RESULT_DOCUMENT_COUNT : offsets[first_index]);
+        Document* destination = documents.data() + offsets[i];
+        if (destination != source) {
+            std::copy(source, source + size, destination);
+        }
+        offsets[i + 1] = offsets[i] + size;
+    }
+    documents.resize(offsets.back());
+    statistics_.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return JoinedDocuments(std::move(documents), std::move(offsets));
+}
+
+void QueryBatch::ScoreDistinct(const std::vector<std::string>& queries, std::vector<size_t>& first_indexes,
+    const std::function<void(size_t, TopDocuments&)>& store) {
+
+    struct TermStatistics {
+        double inverse_document_freq;
+        size_t posting_count;
+    };
+    // Words are views of the queries, which outlive the batch
+    std::unordered_map<std::string_view, std::optional<TermId>> term_ids;
+    std::unordered_map<TermId, TermStatistics> term_statistics;
+    const auto find_term = [&](const std::string_view word) {
+        const auto [it, inserted] = term_ids.try_emplace(word);
+        if (inserted) {
+            it->second = search_server_.dictionary_.Find(word);
+        }
+        return it->second;
+    };
+    const auto get_term_statistics = [&](TermId term_id) -> const TermStatistics& {
+        const auto [it, inserted] = term_statistics.try_emplace(term_id);
+        if (inserted) {
+            const size_t posting_count = search_server_.word_to_document_freqs_[term_id].size();
+            it->second = { posting_count > 0 ? search_server_.ComputeWordInverseDocumentFreq(term_id) : 0.0, posting_count };
+        }
+        return it->second;
+    };
+
+    std::vector<SearchServer::Query> distinct_queries;
+    std::vector<size_t> costs;
+    // Index of the first query of each distinct one, and of every query
+    std::vector<size_t> distinct_first_indexes;
+    std::vector<size_t> distinct_indexes(queries.size());
+    first_indexes.assign(queries.size(), 0);
+    // Plus word count, then the plus and minus term ids
+    std::map<std::vector<TermId>, size_t> distinct_keys;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        SearchServer::Query query;
+        std::string_view invalid_word;
+        if (search_server_.ParseQuery(queries[i], true, query, invalid_word, find_term) != QueryError::NONE) {
+            throw std::invalid_argument("Query word "s + std::string(invalid_word) + " is invalid"s);
+        }
+        std::vector<TermId> key;
+        key.reserve(1 + query.plus_words.size() + query.minus_words.size());
+        key.push_back(static_cast<TermId>(query.plus_words.size()));
+        key.insert(key.end(), query.plus_words.begin(), query.plus_words.end());
+        key.insert(key.end(), query.minus_words.begin(), query.minus_words.end());
+        const auto [it, inserted] = distinct_keys.try_emplace(std::move(key), distinct_queries.size());
+        distinct_indexes[i] = it->second;
+        first_indexes[i] = inserted ? i : distinct_first_indexes[it->second];
+        if (!inserted) {
+            continue;
+        }
+        distinct_first_indexes.push_back(i);
+        // Scoring reads every posting of the query's words
+        size_t cost = 1;
+        query.inverse_document_freqs.resize(query.plus_words.size());
+        for (size_t j = 0; j < query.plus_words.size(); ++j) {
+            const TermStatistics& statistics = get_term_statistics(query.plus_words[j]);
+            query.inverse_document_freqs[j] = statistics.inverse_document_freq;
+            cost += statistics.posting_count;
+        }
+        for (const TermId term_id : query.minus_words) {
+            cost += get_term_statistics(term_id).posting_count;
+        }
+        distinct_queries.push_back(std::move(query));
+        costs.push_back(cost);
+    }
+
+    std::vector<size_t> order(distinct_queries.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&costs](size_t lhs, size_t rhs) {
+        return costs[lhs] > costs[rhs];
+    });
+    std::vector<double> distinct_latencies(distinct_queries.size());
+    const std::function<void(size_t)> score = [&](size_t task) {
+        const auto task_start = Clock::now();
+        store(distinct_first_indexes[task], search_server_.ScoreTopDocuments(distinct_queries[task],
+            SearchServer::StatusPredicate{ DocumentStatus::ACTUAL }, MAX_RESULT_DOCUMENT_COUNT));
+        distinct_latencies[task] = std::chrono::duration<double, std::milli>(Clock::now() - task_start).count();
+    };
+    if (!GetWorkerPool().TryRun(order, std::min(distinct_queries.size(), thread_count_), score)) {
+        for (const size_t task : order) {
+            score(task);
+        }
+    }
+
+    std::vector<double> latencies(queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        latencies[i] = distinct_latencies[distinct_indexes[i]];
+    }
+    std::sort(latencies.begin(), latencies.end());
+    statistics_.query_count = queries.size();
+    statistics_.distinct_query_count = distinct_queries.size();
+    statistics_.latency_p50 = GetPercentile(latencies, 50);
+    statistics_.latency_p90 = GetPercentile(latencies, 90);
+    statistics_.latency_p99 = GetPercentile(latencies, 99);
+    statistics_.latency_max = latencies.empty() ? 0.0 : latencies.back();
+}
+
+const QueryBatchStatistics& QueryBatch::GetStatistics() const {
+    return statistics_;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "document.h"
+#include "joined_documents.h"
+#include "search_server.h"
+#include "top_documents.h"
+
+struct QueryBatchStatistics {
+    size_t query_count = 0;
+    // Queries left after dropping repeats within the batch
+    size_t distinct_query_count = 0;
+    double seconds = 0.0;
+    // Time to score each query, in milliseconds; a repeated query takes the
+    // time of the one it repeats
+    double latency_p50 = 0.0;
+    double latency_p90 = 0.0;
+    double latency_p99 = 0.0;
+    double latency_max = 0.0;
+
+    double GetQueriesPerSecond() const;
+};
+
+std::ostream& operator<<(std::ostream& out, const QueryBatchStatistics& statistics);
+
+// Answers a batch of queries to one SearchServer like FindTopDocuments with
+// DocumentStatus::ACTUAL. The batch is parsed up front: each distinct word is
+// looked up and gets its inverse document frequency once, and a query that
+// repeats an earlier one, after parsing, is scored only once. Queries are
+// then scored on a pool of threads, each with its own queue that others
+// steal from once theirs are empty. Queues are filled most expensive query
+// first, by the length of the posting lists involved, so the heavy queries
+// start early instead of finishing last on an otherwise idle pool.
+// The pool has a thread per core and is shared by every QueryBatch, whose
+// threads stay up between batches. A batch that finds it busy with another
+// one is scored on the calling thread.
+class QueryBatch {
+public:
+    // thread_count 0, or more than there are cores, means one thread per core
+    explicit QueryBatch(const SearchServer& search_server, size_t thread_count = 0);
+
+    // Results in query order. Throws std::invalid_argument for an invalid
+    // query before any query is scored.
+    std::vector<std::vector<Document>> Process(const std::vector<std::string>& queries);
+
+    // Same results, written straight into one buffer
+    JoinedDocuments ProcessJoined(const std::vector<std::string>& queries);
+
+    // Of the last Process or ProcessJoined call
+    const QueryBatchStatistics& GetStatistics() const;
+
+private:
+    const SearchServer& search_server_;
+    const size_t thread_count_;
+    QueryBatchStatistics statistics_;
+
+    // Scores each distinct query once, on the worker pool, and hands its top
+    // to store along with the index of the first query that parses to it.
+    // first_indexes gets that index for every query. Fills in everything in
+    // statistics_ but the total time.
+    void ScoreDistinct(const std::vector<std::string>& queries, std::vector<size_t>& first_indexes,
+        const std::function<void(size_t, TopDocuments&)>& store);
+};
@@ -0,0 +1,109 @@
+#include "query_cache.h"
+
+#include <algorithm>
+
+QueryCache::QueryCache(const SearchServer& search_server, size_t memory_budget, size_t shard_count)
+    : search_server_(search_server)
+    , shard_budget_(memory_budget / std::max<size_t>(shard_count, 1))
+    , shards_(std::max<size_t>(shard_count, 1))
+{
+}
+
+std::vector<Document> QueryCache::FindTopDocuments(const std::string_view raw_query, DocumentStatus status, size_t top_count) {
+    SearchServer::Query query = search_server_.ParseQuery(raw_query, true);
+    Key key;
+    key.reserve(3 + query.plus_words.size() + query.minus_words.size());
+    key.push_back(static_cast<uint32_t>(status));
+    key.push_back(static_cast<uint32_t>(std::min<size_t>(top_count, UINT32_MAX)));
+    key.push_back(static_cast<uint32_t>(query.plus_words.size()));
+    key.insert(key.end(), query.plus_words.begin(), query.plus_words.end());
+    key.insert(key.end(), query.minus_words.begin(), query.minus_words.end());
+
+    const uint64_t generation = search_server_.GetGeneration();
+    Shard& shard = shards_[KeyHash{}(key) % shards_.size()];
+    {
+        std::lock_guard guard(shard.mutex);
+        Validate(shard, generation);
+        if (const auto it = shard.index.find(key); it != shard.index.end()) {
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            ++hit_count_;
+            return it->second->documents;
+        }
+    }
+    ++miss_count_;
+
+    search_server_.ComputeInverseDocumentFreqs(query);
+    std::vector<Document> documents = search_server_.FindTopDocumentsForQuery(std::execution::seq, query,
+        SearchServer::StatusPredicate{ status }, top_count);
+
+    Entry entry{ std::move(key), documents };
+    const size_t entry_size = GetEntrySize(entry);
+    if (entry_size > shard_budget_) {
+        return documents;
+    }
+    std::lock_guard guard(shard.mutex);
+    Validate(shard, generation);
+    // Another thread may have cached the same query meanwhile
+    if (shard.index.count(entry.key) > 0) {
+        return documents;
+    }
+    shard.entries.push_front(std::move(entry));
+    shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+    shard.memory_usage += entry_size;
+    while (shard.memory_usage > shard_budget_) {
+        shard.memory_usage -= GetEntrySize(shard.entries.back());
+        shard.index.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+    }
+    return documents;
+}
+
+uint64_t QueryCache::GetHitCount() const {
+    return hit_count_;
+}
+
+uint64_t QueryCache::GetMissCount() const {
+    return miss_count_;
+}
+
+size_t QueryCache::GetMemoryUsage() const {
+    size_t memory_usage = 0;
+    for (const Shard& shard : shards_) {
+        std::lock_guard guard(shard.mutex);
+        memory_usage += shard.memory_usage;
+    }
+    return memory_usage;
+}
+
+void QueryCache::Clear() {
+    for (Shard& shard : shards_) {
+        std::lock_guard guard(shard.mutex);
+        shard.entries.clear();
+        shard.index.clear();
+        shard.memory_usage = 0;
+    }
+}
+
+size_t QueryCache::KeyHash::operator()(const Key& key) const {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const uint32_t value : key) {
+        hash = (hash ^ value) * 0x100000001b3ULL;
+    }
+    return static_cast<size_t>(hash ^ (hash >> 32));
+}
+
+size_t QueryCache::GetEntrySize(const Entry& entry) {
+    // The key is stored twice, in the list and in the index; nodes cost
+    // roughly four pointers each
+    return sizeof(Entry) + 2 * entry.key.capacity() * sizeof(uint32_t) + entry.documents.capacity() * sizeof(Document)
+        + sizeof(Key) + 8 * sizeof(void*);
+}
+
+void QueryCache::Validate(Shard& shard, uint64_t generation) {
+    if (shard.generation != generation) {
+        shard.entries.clear();
+        shard.index.clear();
+        shard.memory_usage = 0;
+        shard.generation = generation;
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+// Results of recent queries to one SearchServer. Queries are keyed by their
+// parsed form, so word order, repeated words, stop words and words absent
+// from the index don't matter. Any change to the index drops every entry.
+// Entries are split into independently locked shards, each evicting its
+// least recently used entries once it exceeds its part of the budget.
+// Safe to use from several threads as long as the index doesn't change
+// meanwhile, the same as the SearchServer itself.
+class QueryCache {
+public:
+    static constexpr size_t DEFAULT_MEMORY_BUDGET = 64 << 20;
+
+    explicit QueryCache(const SearchServer& search_server, size_t memory_budget = DEFAULT_MEMORY_BUDGET, size_t shard_count = 16);
+
+    QueryCache(const QueryCache&) = delete;
+    QueryCache& operator=(const QueryCache&) = delete;
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT);
+
+    uint64_t GetHitCount() const;
+
+    uint64_t GetMissCount() const;
+
+    // Approximate bytes held by the cached entries
+    size_t GetMemoryUsage() const;
+
+    void Clear();
+
+private:
+    // Status, top count, plus word count, then the sorted plus and minus term ids
+    using Key = std::vector<uint32_t>;
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Entry {
+        Key key;
+        std::vector<Document> documents;
+    };
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        // Most recently used first
+        std::list<Entry> entries;
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+        uint64_t generation = 0;
+        size_t memory_usage = 0;
+    };
+
+    const SearchServer& search_server_;
+    const size_t shard_budget_;
+    std::vector<Shard> shards_;
+    std::atomic<uint64_t> hit_count_ = 0;
+    std::atomic<uint64_t> miss_count_ = 0;
+
+    static size_t GetEntrySize(const Entry& entry);
+
+    // Drops the shard's entries if they were made for an older index
+    static void Validate(Shard& shard, uint64_t generation);
+};
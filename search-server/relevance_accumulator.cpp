@@ -0,0 +1,18 @@
+#include "relevance_accumulator.h"
+
+void RelevanceAccumulator::Reset(size_t slot_count) {
+    for (const uint32_t slot : touched_slots_) {
+        relevances_[slot] = 0.0;
+        touched_bits_[slot / 64] = 0;
+    }
+    for (const uint32_t word : excluded_words_) {
+        excluded_bits_[word] = 0;
+    }
+    touched_slots_.clear();
+    excluded_words_.clear();
+    if (relevances_.size() < slot_count) {
+        relevances_.resize(slot_count, 0.0);
+        touched_bits_.resize((slot_count + 63) / 64, 0);
+        excluded_bits_.resize((slot_count + 63) / 64, 0);
+    }
+}
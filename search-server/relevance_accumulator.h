@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Flat per-slot relevance sums for one query at a time. Only touched slots
+// and excluded bitmap words are cleared on Reset, so an accumulator reused
+// across queries costs no allocation once it has grown to the index size.
+class RelevanceAccumulator {
+public:
+    void Reset(size_t slot_count);
+
+    void Add(uint32_t slot, double relevance);
+
+    void Exclude(uint32_t slot);
+
+    bool IsExcluded(uint32_t slot) const;
+
+    template <typename Function>
+    void ForEach(Function function) const;
+
+private:
+    std::vector<double> relevances_;
+    std::vector<uint64_t> touched_bits_;
+    std::vector<uint64_t> excluded_bits_;
+    std::vector<uint32_t> touched_slots_;
+    std::vector<uint32_t> excluded_words_;
+};
+
+inline void RelevanceAccumulator::Add(uint32_t slot, double relevance) {
+    uint64_t& word = touched_bits_[slot / 64];
+    const uint64_t bit = uint64_t{ 1 } << (slot % 64);
+    if ((word & bit) == 0) {
+        word |= bit;
+        touched_slots_.push_back(slot);
+    }
+    relevances_[slot] += relevance;
+}
+
+inline void RelevanceAccumulator::Exclude(uint32_t slot) {
+    uint64_t& word = excluded_bits_[slot / 64];
+    if (word == 0) {
+        excluded_words_.push_back(slot / 64);
+    }
+    word |= uint64_t{ 1 } << (slot % 64);
+}
+
+inline bool RelevanceAccumulator::IsExcluded(uint32_t slot) const {
+    return (excluded_bits_[slot / 64] >> (slot % 64)) & 1;
+}
+
+template <typename Function>
+void RelevanceAccumulator::ForEach(Function function) const {
+    for (const uint32_t slot : touched_slots_) {
+        if (!IsExcluded(slot)) {
+            function(slot, relevances_[slot]);
+        }
+    }
+}
@@ -1,32 +1,31 @@
 #include "remove_duplicates.h"
 
+#include <unordered_set>
+
 using namespace std;
 
-void RemoveDuplicates(SearchServer & search_server) 
+vector<int> FindDuplicates(const SearchServer& search_server)
 {
-    set<set<string>> document;
-    vector<int> deleted_document;
-    
-    for (auto document_id : search_server) 
+    unordered_set<WordSetFingerprint, WordSetFingerprintHash> fingerprints;
+    fingerprints.reserve(search_server.GetDocumentCount());
+    vector<int> duplicates;
+    // Ascending ids, so the first document with a word set is the one kept
+    for (const int document_id : search_server)
     {
-        set<string> word_in_document;
-        for (auto & [word, freq] : search_server.GetWordFrequencies(document_id)) 
-        {
-            word_in_document.insert(word);
-        }
-        
-        if(document.find(word_in_document) == document.end())
-        {
-            document.insert(word_in_document);
-        }
-        else
+        if (!fingerprints.insert(search_server.GetWordSetFingerprint(document_id)).second)
         {
-            deleted_document.push_back(document_id);
+            duplicates.push_back(document_id);
         }
     }
-   for (int i : deleted_document) 
-   {
-   search_server.RemoveDocument(i);
-   cout << "Found duplicate document id " << i << endl;
-   }
+    return duplicates;
+}
+
+vector<int> RemoveDuplicates(SearchServer& search_server)
+{
+    vector<int> duplicates = FindDuplicates(search_server);
+    for (const int document_id : duplicates)
+    {
+        search_server.RemoveDocument(document_id);
+    }
+    return duplicates;
 }
\ No newline at end of file
@@ -1,5 +1,13 @@
 #pragma once
 
+#include <vector>
+
 #include "search_server.h"
 
-void RemoveDuplicates(SearchServer& search_server);
\ No newline at end of file
+// Ids of the documents with the same set of words as a document with a
+// smaller id, ascending. Documents are compared by the word set
+// fingerprints the server keeps, so this takes one hash lookup each.
+std::vector<int> FindDuplicates(const SearchServer& search_server);
+
+// Removes every duplicate found by FindDuplicates and returns their ids
+std::vector<int> RemoveDuplicates(SearchServer& search_server);
\ No newline at end of file
@@ -1,8 +1,85 @@
 #include "search_server.h"
 
+#include <cstring>
+#include <exception>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "sorted_id_kernels.h"
+
 using std::string_literals::operator""s;
 using std::string_view_literals::operator""sv;
 
+namespace {
+
+struct BatchPosting {
+    uint32_t document;
+    uint32_t term_count;
+};
+
+// Consecutive documents of a batch, tokenized against a vocabulary of
+// their own so that chunks don't share anything while they are built
+struct BatchChunk {
+    size_t first = 0;
+    size_t last = 0;
+    std::vector<std::string_view> words;
+    // Terms of document first + i are [term_offsets[i], term_offsets[i + 1]);
+    // ids are chunk-local until the vocabularies are merged
+    std::vector<uint32_t> term_offsets;
+    std::vector<TermId> term_ids;
+    std::vector<uint32_t> term_counts;
+    std::exception_ptr error;
+    // Set once the vocabularies are merged: entries are sorted by term id
+    // within each document, and the postings of term t, with documents
+    // numbered within the batch, are [term_posting_offsets[t], term_posting_offsets[t + 1])
+    std::vector<ForwardEntry> entries;
+    std::vector<uint32_t> term_posting_offsets;
+    std::vector<BatchPosting> postings;
+};
+
+// Once a posting list is this many times longer than the candidates,
+// probing it through its block index beats decoding it
+constexpr size_t PROBE_RATIO = 64;
+
+// Keeps the candidates that are (keep_matches) or aren't in postings; ids
+// is scratch space for the decoded list
+void NarrowCandidates(const PostingList& postings, bool keep_matches, std::vector<int>& candidates, std::vector<int>& ids) {
+    if (postings.size() >= PROBE_RATIO * candidates.size()) {
+        PostingList::Cursor cursor(postings);
+        const auto end = std::remove_if(candidates.begin(), candidates.end(), [&](int internal_id) {
+            cursor.SkipTo(internal_id);
+            const bool found = !cursor.AtEnd() && cursor.GetDocumentId() == internal_id;
+            return found != keep_matches;
+        });
+        candidates.erase(end, candidates.end());
+        return;
+    }
+    ids.clear();
+    postings.ForEach([&ids](int internal_id, uint32_t) {
+        ids.push_back(internal_id);
+    });
+    candidates.resize(keep_matches
+        ? IntersectSortedIds(candidates.data(), candidates.size(), ids.data(), ids.size(), candidates.data())
+        : SubtractSortedIds(candidates.data(), candidates.size(), ids.data(), ids.size(), candidates.data()));
+}
+
+// A view of count values at the position of reader, which sections keep aligned
+template <typename T>
+const T* MapArray(IndexSectionReader& reader, size_t count) {
+    if (count > std::numeric_limits<size_t>::max() / sizeof(T)) {
+        throw std::runtime_error("Index file section is truncated"s);
+    }
+    return reinterpret_cast<const T*>(reader.Skip(count * sizeof(T)));
+}
+
+void CheckOffsets(const uint64_t* offsets, size_t count, size_t size) {
+    if (!std::is_sorted(offsets, offsets + count) || offsets[count - 1] > size) {
+        throw std::runtime_error("Index file offsets are corrupted"s);
+    }
+}
+
+}
+
 SearchServer::SearchServer(const std::string& stop_words_text)
     : SearchServer(SplitIntoWords(stop_words_text))  
 {
@@ -14,62 +91,314 @@ SearchServer::SearchServer(const std::string_view stop_words_text)
 }
 
 void SearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
-    if ((document_id < 0) || (SearchServer::documents_.count(document_id) > 0)) {
+    if ((document_id < 0) || document_ids_.Contains(document_id)) {
         throw std::invalid_argument("Invalid document_id"s);
     }
-    const auto words = SplitIntoWordsNoStop(document);
+    static thread_local std::vector<std::string_view> words;
+    SplitIntoWordsNoStop(document, words);
 
-    const double inv_word_count = 1.0 / words.size();
+    const double inv_word_count = words.empty() ? 0.0 : 1.0 / words.size();
+    static thread_local std::vector<TermId> term_ids;
+    static thread_local std::vector<ForwardEntry> entries;
+    term_ids.clear();
     for (const std::string_view word : words) {
-        word_to_document_freqs_[std::basic_string(word)][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][word] += inv_word_count;
+        term_ids.push_back(dictionary_.Intern(word));
+    }
+    std::sort(term_ids.begin(), term_ids.end());
+    entries.clear();
+    for (size_t i = 0; i < term_ids.size(); ++i) {
+        if (i == 0 || term_ids[i] != term_ids[i - 1]) {
+            entries.push_back({ term_ids[i], 0 });
+        }
+        ++entries.back().term_count;
     }
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
-    document_ids_.insert(document_id);
+    AddDocumentTerms(document_id, { entries.data(), entries.data() + entries.size() }, inv_word_count, status,
+        ComputeAverageRating(ratings));
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-        return document_status == status;
-        });
+void SearchServer::AddDocumentTerms(int document_id, ForwardIndex::Terms terms, double inv_word_count,
+    DocumentStatus status, int rating) {
+    const uint32_t internal_id = AddDocumentSlot(document_id, status, rating, inv_word_count);
+    word_to_document_freqs_.resize(dictionary_.size());
+    for (const auto [term_id, term_count] : terms) {
+        word_to_document_freqs_[term_id].Add(internal_id, term_count);
+    }
+    forward_index_.Add(terms);
+    word_set_fingerprints_[internal_id] = ComputeWordSetFingerprint(terms);
+}
+
+uint32_t SearchServer::AddDocumentSlot(int document_id, DocumentStatus status, int rating, double inv_word_count) {
+    ++generation_;
+    const uint32_t internal_id = static_cast<uint32_t>(internal_to_external_.size());
+    internal_to_external_.push_back(document_id);
+    ratings_.push_back(rating);
+    statuses_.push_back(status);
+    inv_word_counts_.push_back(inv_word_count);
+    word_set_fingerprints_.push_back({});
+    if (internal_id % 64 == 0) {
+        for (MappedVector<uint64_t>& bitmap : status_bitmaps_) {
+            bitmap.push_back(0);
+        }
+    }
+    status_bitmaps_[static_cast<size_t>(status)][internal_id / 64] |= uint64_t{ 1 } << (internal_id % 64);
+    document_ids_.Add(document_id, internal_id);
+    ExtendLogTable();
+    return internal_id;
+}
+
+void SearchServer::RemoveDocumentSlot(uint32_t internal_id) {
+    ++generation_;
+    const int document_id = internal_to_external_[internal_id];
+    status_bitmaps_[static_cast<size_t>(statuses_[internal_id])][internal_id / 64] &= ~(uint64_t{ 1 } << (internal_id % 64));
+    document_ids_.Remove(document_id);
+}
+
+std::optional<uint32_t> SearchServer::FindInternalId(int document_id) const {
+    return document_ids_.Find(document_id);
+}
+
+uint32_t SearchServer::GetInternalId(int document_id) const {
+    const auto internal_id = FindInternalId(document_id);
+    if (!internal_id) {
+        throw std::out_of_range("Unknown document_id"s);
+    }
+    return *internal_id;
+}
+
+bool SearchServer::IsLive(uint32_t internal_id) const {
+    const MappedVector<uint64_t>& bitmap = status_bitmaps_[static_cast<size_t>(statuses_[internal_id])];
+    return (bitmap[internal_id / 64] >> (internal_id % 64)) & 1;
+}
+
+void SearchServer::AddDocuments(const std::vector<NewDocument>& documents) {
+    AddDocuments(std::execution::seq, documents);
+}
+
+void SearchServer::AddDocuments(const std::execution::sequenced_policy&, const std::vector<NewDocument>& documents) {
+    AddDocumentBatch(documents, 1);
+}
+
+void SearchServer::AddDocuments(const std::execution::parallel_policy&, const std::vector<NewDocument>& documents) {
+    // More chunks than cores only add merge work
+    const size_t max_chunk_count = std::max(1u, std::thread::hardware_concurrency());
+    AddDocumentBatch(documents, std::clamp<size_t>(documents.size() / MIN_BATCH_CHUNK_SIZE, 1, max_chunk_count));
+}
+
+void SearchServer::AddDocumentBatch(const std::vector<NewDocument>& documents, size_t chunk_count) {
+    std::unordered_set<int> batch_ids;
+    for (const NewDocument& document : documents) {
+        if (document.id < 0 || document_ids_.Contains(document.id) || !batch_ids.insert(document.id).second) {
+            throw std::invalid_argument("Invalid document_id"s);
+        }
+    }
+    if (documents.empty()) {
+        return;
+    }
+
+    // Tokenize every chunk on its own, keeping the first error of each
+    const size_t chunk_size = (documents.size() + chunk_count - 1) / chunk_count;
+    std::vector<BatchChunk> chunks(chunk_count);
+    std::vector<double> inv_word_counts(documents.size());
+    for (size_t i = 0; i < chunk_count; ++i) {
+        chunks[i].first = std::min(documents.size(), i * chunk_size);
+        chunks[i].last = std::min(documents.size(), chunks[i].first + chunk_size);
+    }
+    std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](BatchChunk& chunk) {
+        try {
+            std::unordered_map<std::string_view, TermId> local_ids;
+            std::vector<TermId> document_terms;
+            std::vector<std::string_view> words;
+            chunk.term_offsets.push_back(0);
+            for (size_t i = chunk.first; i < chunk.last; ++i) {
+                SplitIntoWordsNoStop(documents[i].text, words);
+                inv_word_counts[i] = words.empty() ? 0.0 : 1.0 / words.size();
+                document_terms.clear();
+                for (const std::string_view word : words) {
+                    const auto [it, inserted] = local_ids.emplace(word, static_cast<TermId>(chunk.words.size()));
+                    if (inserted) {
+                        chunk.words.push_back(word);
+                    }
+                    document_terms.push_back(it->second);
+                }
+                std::sort(document_terms.begin(), document_terms.end());
+                for (size_t j = 0; j < document_terms.size(); ++j) {
+                    if (j == 0 || document_terms[j] != document_terms[j - 1]) {
+                        chunk.term_ids.push_back(document_terms[j]);
+                        chunk.term_counts.push_back(0);
+                    }
+                    ++chunk.term_counts.back();
+                }
+                chunk.term_offsets.push_back(static_cast<uint32_t>(chunk.term_ids.size()));
+            }
+        }
+        catch (...) {
+            chunk.error = std::current_exception();
+        }
+    });
+    for (const BatchChunk& chunk : chunks) {
+        if (chunk.error) {
+            std::rethrow_exception(chunk.error);
+        }
+    }
+
+    // Chunk vocabularies are interned in chunk order, so words get the same
+    // ids as with one AddDocument call per document
+    std::vector<std::vector<TermId>> term_id_maps(chunk_count);
+    for (size_t i = 0; i < chunk_count; ++i) {
+        term_id_maps[i].reserve(chunks[i].words.size());
+        for (const std::string_view word : chunks[i].words) {
+            term_id_maps[i].push_back(dictionary_.Intern(word));
+        }
+    }
+    const size_t term_count = dictionary_.size();
+    word_to_document_freqs_.resize(term_count);
+
+    // Per chunk: forward index entries with global term ids, fingerprints,
+    // and postings grouped by term through a counting sort, which keeps the
+    // documents of every term in order
+    std::vector<WordSetFingerprint> fingerprints(documents.size());
+    std::vector<size_t> chunk_positions(chunk_count);
+    std::iota(chunk_positions.begin(), chunk_positions.end(), 0);
+    std::for_each(std::execution::par, chunk_positions.begin(), chunk_positions.end(), [&](size_t c) {
+        BatchChunk& chunk = chunks[c];
+        chunk.entries.resize(chunk.term_ids.size());
+        chunk.term_posting_offsets.assign(term_count + 1, 0);
+        for (size_t i = chunk.first; i < chunk.last; ++i) {
+            const uint32_t first = chunk.term_offsets[i - chunk.first];
+            const uint32_t last = chunk.term_offsets[i - chunk.first + 1];
+            for (uint32_t j = first; j < last; ++j) {
+                chunk.entries[j] = { term_id_maps[c][chunk.term_ids[j]], chunk.term_counts[j] };
+                ++chunk.term_posting_offsets[chunk.entries[j].term_id + 1];
+            }
+            std::sort(chunk.entries.begin() + first, chunk.entries.begin() + last, [](const ForwardEntry& lhs, const ForwardEntry& rhs) {
+                return lhs.term_id < rhs.term_id;
+            });
+            fingerprints[i] = ComputeWordSetFingerprint({ chunk.entries.data() + first, chunk.entries.data() + last });
+        }
+        std::partial_sum(chunk.term_posting_offsets.begin(), chunk.term_posting_offsets.end(), chunk.term_posting_offsets.begin());
+        std::vector<uint32_t> positions(chunk.term_posting_offsets.begin(), chunk.term_posting_offsets.end() - 1);
+        chunk.postings.resize(chunk.entries.size());
+        for (size_t i = chunk.first; i < chunk.last; ++i) {
+            for (uint32_t j = chunk.term_offsets[i - chunk.first]; j < chunk.term_offsets[i - chunk.first + 1]; ++j) {
+                chunk.postings[positions[chunk.entries[j].term_id]++] = { static_cast<uint32_t>(i), chunk.entries[j].term_count };
+            }
+        }
+    });
+
+    const uint32_t first_internal_id = static_cast<uint32_t>(internal_to_external_.size());
+    size_t posting_count = 0;
+    for (const BatchChunk& chunk : chunks) {
+        posting_count += chunk.entries.size();
+    }
+    document_ids_.Reserve(document_ids_.size() + documents.size());
+    forward_index_.Reserve(documents.size(), posting_count);
+    for (const BatchChunk& chunk : chunks) {
+        for (size_t i = chunk.first; i < chunk.last; ++i) {
+            const NewDocument& document = documents[i];
+            const uint32_t internal_id = AddDocumentSlot(document.id, document.status, ComputeAverageRating(document.ratings),
+                inv_word_counts[i]);
+            forward_index_.Add({ chunk.entries.data() + chunk.term_offsets[i - chunk.first],
+                chunk.entries.data() + chunk.term_offsets[i - chunk.first + 1] });
+            word_set_fingerprints_[internal_id] = fingerprints[i];
+        }
+    }
+
+    // Every task owns a range of terms holding about the same number of
+    // postings, and appends them chunk by chunk, so ids stay ascending
+    std::vector<TermId> range_bounds{ 0 };
+    const size_t range_posting_count = posting_count / chunk_count + 1;
+    size_t range_size = 0;
+    for (TermId term_id = 0; term_id < term_count; ++term_id) {
+        for (const BatchChunk& chunk : chunks) {
+            range_size += chunk.term_posting_offsets[term_id + 1] - chunk.term_posting_offsets[term_id];
+        }
+        if (range_size >= range_posting_count) {
+            range_bounds.push_back(term_id + 1);
+            range_size = 0;
+        }
+    }
+    range_bounds.push_back(static_cast<TermId>(term_count));
+    std::vector<size_t> ranges(range_bounds.size() - 1);
+    std::iota(ranges.begin(), ranges.end(), 0);
+    std::for_each(std::execution::par, ranges.begin(), ranges.end(), [&](size_t range) {
+        for (TermId term_id = range_bounds[range]; term_id < range_bounds[range + 1]; ++term_id) {
+            PostingList& postings = word_to_document_freqs_[term_id];
+            for (const BatchChunk& chunk : chunks) {
+                for (uint32_t j = chunk.term_posting_offsets[term_id]; j < chunk.term_posting_offsets[term_id + 1]; ++j) {
+                    const BatchPosting& posting = chunk.postings[j];
+                    postings.Add(first_internal_id + posting.document, posting.term_count);
+                }
+            }
+        }
+    });
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status, size_t top_count) const {
+    return FindTopDocuments(raw_query, StatusPredicate{ status }, top_count);
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query) const {
     return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
+std::vector<Document> SearchServer::FindTopDocumentsWithAllWords(const std::string_view raw_query, DocumentStatus status,
+    size_t top_count) const {
+    return FindTopDocumentsWithAllWords(raw_query, StatusPredicate{ status }, top_count);
+}
+
+QueryError SearchServer::TryFindTopDocuments(const std::string_view raw_query, DocumentStatus status, std::vector<Document>& result,
+    size_t top_count) const {
+    return TryFindTopDocuments(raw_query, StatusPredicate{ status }, result, top_count);
+}
+
+uint64_t SearchServer::GetGeneration() const {
+    return generation_;
+}
+
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return static_cast<int>(document_ids_.size());
+}
+
+size_t SearchServer::GetTextStorageBytes() const {
+    return dictionary_.GetTextBytes();
 }
 
-const std::set<int>::const_iterator SearchServer::begin() const
+DocumentIdMap::Iterator SearchServer::begin() const
 {
-    return document_ids_.cbegin();
+    return document_ids_.begin();
 }
 
-const std::set<int>::const_iterator SearchServer::end() const
+DocumentIdMap::Iterator SearchServer::end() const
 {
-    return document_ids_.cend();
+    return document_ids_.end();
+}
+
+std::map<std::string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
+    const uint32_t internal_id = GetInternalId(document_id);
+    std::map<std::string_view, double> word_freqs;
+    const double inv_word_count = inv_word_counts_[internal_id];
+    for (const auto [term_id, term_count] : forward_index_.GetTerms(internal_id)) {
+        word_freqs.emplace(dictionary_.GetTerm(term_id), term_count * inv_word_count);
+    }
+    return word_freqs;
 }
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    
-    return document_to_word_freqs_.at(document_id);
+WordSetFingerprint SearchServer::GetWordSetFingerprint(int document_id) const {
+    return word_set_fingerprints_[GetInternalId(document_id)];
 }
 
 void SearchServer::RemoveDocument(int document_id) 
 {
-    if(find(document_ids_.begin(), document_ids_.end(), document_id) == document_ids_.end())
+    const auto internal_id = FindInternalId(document_id);
+    if (!internal_id)
     {
         return;
     }
-    for (auto [word, freq] : document_to_word_freqs_[document_id])
+    RemoveDocumentSlot(*internal_id);
+    for (auto [term_id, term_count] : forward_index_.GetTerms(*internal_id))
     {
-        word_to_document_freqs_[std::basic_string(word)].erase(document_id);
+        word_to_document_freqs_[term_id].Remove(*internal_id);
     }
-    document_to_word_freqs_.erase(document_id);
-    documents_.erase(document_id);
-    document_ids_.erase(find(document_ids_.begin(), document_ids_.end(), document_id));
 }
 
 
@@ -79,48 +408,209 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::sequenced_policy&, const std::string_view raw_query, int document_id) const {
     auto query = ParseQuery(raw_query,true);
+    const uint32_t internal_id = GetInternalId(document_id);
 
     std::vector<std::string_view> matched_words;
 
-    for (const std::string_view word : query.plus_words) {
-        if (document_to_word_freqs_.at(document_id).count(word) == 0) {
-            continue;
-        }
-        if (SearchServer::document_to_word_freqs_.at(document_id).count(word)) {
-            matched_words.push_back(word);
+    for (const TermId term_id : query.minus_words) {
+
+        if (forward_index_.GetTermCount(internal_id, term_id)) {
+            return { std::vector<std::string_view>{}, statuses_[internal_id] };
         }
     }
 
-    for (const std::string_view word : query.minus_words) {
-
-        if (SearchServer::document_to_word_freqs_.at(document_id).count(word)) {
-            return { {},documents_.at(document_id).status };
+    for (const TermId term_id : query.plus_words) {
+        if (forward_index_.GetTermCount(internal_id, term_id)) {
+            matched_words.push_back(dictionary_.GetTerm(term_id));
         }
     }
+    std::sort(matched_words.begin(), matched_words.end());
 
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words, statuses_[internal_id] };
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::parallel_policy&, const std::string_view raw_query, int document_id) const {
 
     SearchServer::Query query = ParseQuery(raw_query,false);
+    const uint32_t internal_id = GetInternalId(document_id);
     bool minus = std::none_of(std::execution::par, query.minus_words.begin(), query.minus_words.end(),
-        [this, document_id](std::string_view word) {
-            return document_to_word_freqs_.at(document_id).count(word) != 0;
+        [this, internal_id](TermId term_id) {
+            return forward_index_.GetTermCount(internal_id, term_id) != 0;
         });
     if (!minus) {
-        return { {},documents_.at(document_id).status };
+        return { std::vector<std::string_view>{}, statuses_[internal_id] };
     }
-    std::vector<std::string_view>matched_words(query.plus_words.size());
+    std::vector<TermId> matched_terms(query.plus_words.size());
 
-    auto it1 = std::copy_if(std::execution::par, std::make_move_iterator(query.plus_words.begin()), std::make_move_iterator(query.plus_words.end()),
-        matched_words.begin(),
-        [this, document_id](std::string_view word) {
-            return (document_to_word_freqs_.at(document_id).count(word));
+    auto it1 = std::copy_if(std::execution::par, query.plus_words.begin(), query.plus_words.end(),
+        matched_terms.begin(),
+        [this, internal_id](TermId term_id) {
+            return forward_index_.GetTermCount(internal_id, term_id) != 0;
         });
-    std::sort(std::execution::par, matched_words.begin(), it1);
-    auto it = std::unique(std::execution::par, matched_words.begin(), it1);
-    return { {matched_words.begin(),it }, documents_.at(document_id).status };
+    std::sort(std::execution::par, matched_terms.begin(), it1);
+    auto it = std::unique(std::execution::par, matched_terms.begin(), it1);
+
+    std::vector<std::string_view> matched_words(std::distance(matched_terms.begin(), it));
+    std::transform(matched_terms.begin(), it, matched_words.begin(),
+        [this](TermId term_id) { return dictionary_.GetTerm(term_id); });
+    std::sort(matched_words.begin(), matched_words.end());
+    return { matched_words, statuses_[internal_id] };
+}
+
+void SearchServer::Save(const std::string& path) const {
+    IndexFileWriter writer(path);
+
+    writer.BeginSection(IndexSection::STOP_WORDS);
+    writer.WriteValue<uint64_t>(stop_words_.size());
+    for (const std::string& word : stop_words_) {
+        writer.WriteValue<uint32_t>(static_cast<uint32_t>(word.size()));
+        writer.Write(word.data(), word.size());
+    }
+    writer.EndSection();
+
+    writer.BeginSection(IndexSection::TERMS);
+    dictionary_.Serialize(writer);
+    writer.EndSection();
+
+    const size_t term_count = dictionary_.size();
+    std::vector<uint64_t> posting_offsets;
+    posting_offsets.reserve(term_count + 1);
+    writer.BeginSection(IndexSection::POSTINGS);
+    for (TermId term_id = 0; term_id < term_count; ++term_id) {
+        posting_offsets.push_back(writer.GetSectionSize());
+        word_to_document_freqs_[term_id].Serialize(writer);
+    }
+    posting_offsets.push_back(writer.GetSectionSize());
+    writer.EndSection();
+
+    writer.BeginSection(IndexSection::POSTING_OFFSETS);
+    writer.Write(posting_offsets.data(), posting_offsets.size() * sizeof(uint64_t));
+    writer.EndSection();
+
+    // One array per column, so that Open can use them in place
+    const size_t slot_count = internal_to_external_.size();
+    writer.BeginSection(IndexSection::DOCUMENTS);
+    writer.WriteValue<uint64_t>(slot_count);
+    writer.Write(internal_to_external_.data(), slot_count * sizeof(int));
+    writer.Write(ratings_.data(), slot_count * sizeof(int));
+    writer.Write(statuses_.data(), slot_count * sizeof(DocumentStatus));
+    writer.Align();
+    writer.Write(inv_word_counts_.data(), slot_count * sizeof(double));
+    writer.Write(word_set_fingerprints_.data(), slot_count * sizeof(WordSetFingerprint));
+    for (const MappedVector<uint64_t>& bitmap : status_bitmaps_) {
+        writer.Write(bitmap.data(), bitmap.size() * sizeof(uint64_t));
+    }
+    writer.WriteValue<uint64_t>(document_ids_.size());
+    for (const int document_id : document_ids_) {
+        writer.WriteValue(DocumentIdMap::Entry{ document_id, *document_ids_.Find(document_id) });
+    }
+    writer.EndSection();
+
+    // Entries of removed documents aren't worth keeping
+    std::vector<uint64_t> forward_offsets{ 0 };
+    forward_offsets.reserve(slot_count + 1);
+    for (uint32_t internal_id = 0; internal_id < slot_count; ++internal_id) {
+        forward_offsets.push_back(forward_offsets.back() + (IsLive(internal_id) ? forward_index_.GetTerms(internal_id).size() : 0));
+    }
+    writer.BeginSection(IndexSection::FORWARD_INDEX);
+    writer.Write(forward_offsets.data(), forward_offsets.size() * sizeof(uint64_t));
+    for (uint32_t internal_id = 0; internal_id < slot_count; ++internal_id) {
+        if (IsLive(internal_id)) {
+            const ForwardIndex::Terms terms = forward_index_.GetTerms(internal_id);
+            writer.Write(terms.begin(), terms.size() * sizeof(ForwardEntry));
+        }
+    }
+    writer.EndSection();
+
+    writer.Finish();
+}
+
+SearchServer SearchServer::Open(const std::string& path, bool verify) {
+    auto file = std::make_shared<const IndexFile>(path);
+    if (verify) {
+        for (const IndexSection section : { IndexSection::STOP_WORDS, IndexSection::TERMS, IndexSection::POSTING_OFFSETS,
+            IndexSection::POSTINGS, IndexSection::DOCUMENTS, IndexSection::FORWARD_INDEX }) {
+            file->VerifySection(section);
+        }
+    }
+
+    IndexSectionReader stop_word_reader(file->GetSection(IndexSection::STOP_WORDS));
+    std::vector<std::string_view> stop_words(stop_word_reader.ReadValue<uint64_t>());
+    for (std::string_view& word : stop_words) {
+        const uint32_t size = stop_word_reader.ReadValue<uint32_t>();
+        word = std::string_view(reinterpret_cast<const char*>(stop_word_reader.Skip(size)), size);
+    }
+    SearchServer search_server(stop_words);
+    search_server.index_file_ = file;
+
+    const IndexFile::Bytes terms = file->GetSection(IndexSection::TERMS);
+    search_server.dictionary_ = TermDictionary::Map(terms.data, terms.size);
+    const size_t term_count = search_server.dictionary_.size();
+
+    IndexSectionReader posting_offset_reader(file->GetSection(IndexSection::POSTING_OFFSETS));
+    const uint64_t* posting_offsets = MapArray<uint64_t>(posting_offset_reader, term_count + 1);
+    const IndexFile::Bytes postings = file->GetSection(IndexSection::POSTINGS);
+    CheckOffsets(posting_offsets, term_count + 1, postings.size);
+    search_server.word_to_document_freqs_.reserve(term_count);
+    for (TermId term_id = 0; term_id < term_count; ++term_id) {
+        search_server.word_to_document_freqs_.push_back(PostingList::Map(postings.data + posting_offsets[term_id],
+            posting_offsets[term_id + 1] - posting_offsets[term_id]));
+    }
+
+    IndexSectionReader document_reader(file->GetSection(IndexSection::DOCUMENTS));
+    const size_t slot_count = document_reader.ReadValue<uint64_t>();
+    const int* ids = MapArray<int>(document_reader, slot_count);
+    const int* ratings = MapArray<int>(document_reader, slot_count);
+    const int32_t* statuses = MapArray<int32_t>(document_reader, slot_count);
+    document_reader.Align();
+    const double* inv_word_counts = MapArray<double>(document_reader, slot_count);
+    const WordSetFingerprint* fingerprints = MapArray<WordSetFingerprint>(document_reader, slot_count);
+    for (MappedVector<uint64_t>& bitmap : search_server.status_bitmaps_) {
+        const size_t word_count = (slot_count + 63) / 64;
+        bitmap = MappedVector<uint64_t>::Map(MapArray<uint64_t>(document_reader, word_count), word_count);
+    }
+    const size_t live_count = document_reader.ReadValue<uint64_t>();
+    const DocumentIdMap::Entry* id_entries = MapArray<DocumentIdMap::Entry>(document_reader, live_count);
+
+    IndexSectionReader forward_reader(file->GetSection(IndexSection::FORWARD_INDEX));
+    const uint64_t* forward_offsets = MapArray<uint64_t>(forward_reader, slot_count + 1);
+    const ForwardEntry* forward_entries = MapArray<ForwardEntry>(forward_reader, forward_offsets[slot_count]);
+
+    if (verify) {
+        // Everything that is later used as an index
+        for (size_t internal_id = 0; internal_id < slot_count; ++internal_id) {
+            if (statuses[internal_id] < 0 || statuses[internal_id] > static_cast<int32_t>(DocumentStatus::REMOVED)) {
+                throw std::runtime_error("Index file documents are corrupted"s);
+            }
+        }
+        for (size_t i = 0; i < live_count; ++i) {
+            if (id_entries[i].internal_id >= slot_count || ids[id_entries[i].internal_id] != id_entries[i].document_id
+                || (i > 0 && id_entries[i - 1].document_id >= id_entries[i].document_id)) {
+                throw std::runtime_error("Index file documents are corrupted"s);
+            }
+        }
+        CheckOffsets(forward_offsets, slot_count + 1, forward_offsets[slot_count]);
+        for (size_t internal_id = 0; internal_id < slot_count; ++internal_id) {
+            for (uint64_t i = forward_offsets[internal_id]; i < forward_offsets[internal_id + 1]; ++i) {
+                if (forward_entries[i].term_id >= term_count
+                    || (i > forward_offsets[internal_id] && forward_entries[i - 1].term_id >= forward_entries[i].term_id)) {
+                    throw std::runtime_error("Index file documents are corrupted"s);
+                }
+            }
+        }
+    }
+
+    static_assert(sizeof(DocumentStatus) == sizeof(int32_t));
+    search_server.internal_to_external_ = MappedVector<int>::Map(ids, slot_count);
+    search_server.ratings_ = MappedVector<int>::Map(ratings, slot_count);
+    search_server.statuses_ = MappedVector<DocumentStatus>::Map(reinterpret_cast<const DocumentStatus*>(statuses), slot_count);
+    search_server.inv_word_counts_ = MappedVector<double>::Map(inv_word_counts, slot_count);
+    search_server.word_set_fingerprints_ = MappedVector<WordSetFingerprint>::Map(fingerprints, slot_count);
+    search_server.document_ids_ = DocumentIdMap::Map(id_entries, live_count);
+    search_server.forward_index_ = ForwardIndex::Map(forward_offsets, forward_entries, slot_count);
+    search_server.generation_ = slot_count;
+    search_server.ExtendLogTable();
+    return search_server;
 }
 
 bool SearchServer::IsStopWord(const std::string_view word) const {
@@ -133,17 +623,18 @@ bool SearchServer::IsValidWord(const std::string_view word) {
         });
 }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view text) const {
-    std::vector<std::string_view> words;
-    for (const std::string_view word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw std::invalid_argument("Word "s + std::basic_string(word) + " is invalid"s);
-        }
-        if (!IsStopWord(word)) {
-            words.push_back(word);
-        }
+void SearchServer::SplitIntoWordsNoStop(const std::string_view text, std::vector<std::string_view>& words) const {
+    const size_t first_control = SplitIntoWords(text, words);
+    if (first_control != text.npos) {
+        const size_t word_start = text.rfind(' ', first_control) + 1;
+        const std::string_view word = text.substr(word_start, text.find(' ', first_control) - word_start);
+        throw std::invalid_argument("Word "s + std::basic_string(word) + " is invalid"s);
+    }
+    if (!stop_words_.empty()) {
+        words.erase(std::remove_if(words.begin(), words.end(), [this](const std::string_view word) {
+            return IsStopWord(word);
+            }), words.end());
     }
-    return words;
 }
 
 int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
@@ -153,48 +644,126 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
     return std::accumulate(ratings.begin(), ratings.end(), 0) / static_cast<int>(ratings.size());
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view word) const {
-    if (word.empty()) {
-        throw std::invalid_argument("Query word is empty"s);
+WordSetFingerprint SearchServer::ComputeWordSetFingerprint(ForwardIndex::Terms terms) {
+    WordSetFingerprintBuilder builder;
+    for (const auto [term_id, term_count] : terms) {
+        builder.Add(term_id);
     }
+    return builder.Get();
+}
+
+QueryError SearchServer::ParseQueryWord(std::string_view word, QueryWord& result) const {
     bool is_minus = false;
     if (word[0] == '-') 
     {
         is_minus = true;
         word = word.substr(1);
     }
-    if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
-        throw std::invalid_argument("Query word "s + std::basic_string(word) + " is invalid"s);
+    if (word.empty()) {
+        return QueryError::EMPTY_MINUS_WORD;
+    }
+    if (word[0] == '-') {
+        return QueryError::DOUBLE_MINUS;
     }
-    return { word, is_minus, IsStopWord(word) };
+    if (!IsValidWord(word)) {
+        return QueryError::INVALID_CHARACTER;
+    }
+    result = { word, is_minus, IsStopWord(word) };
+    return QueryError::NONE;
+}
+
+QueryError SearchServer::ParseQuery(const std::string_view text, bool isUnique, Query& result, std::string_view& invalid_word) const {
+    return ParseQuery(text, isUnique, result, invalid_word, [this](const std::string_view word) {
+        return dictionary_.Find(word);
+    });
 }
+
 SearchServer::Query SearchServer::ParseQuery(const std::string_view text, bool isUnique) const {
     Query result;
-    std::vector<std::string_view>Split = SplitIntoWords(text);
-    for (const std::string_view word : Split) {
-        const auto query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                result.minus_words.emplace_back(query_word.data);
-            }
-            else 
-            {
-                result.plus_words.emplace_back(query_word.data);
-            }
+    std::string_view invalid_word;
+    if (ParseQuery(text, isUnique, result, invalid_word) != QueryError::NONE) {
+        ThrowInvalidQueryWord(invalid_word);
+    }
+    return result;
+}
+
+std::vector<int> SearchServer::FindConjunctiveCandidates(const Query& query) const {
+    std::vector<int> candidates;
+    if (query.plus_words.empty() || query.has_unknown_plus_word) {
+        return candidates;
+    }
+    // Shortest list first: it bounds the candidates, and every later list
+    // can only shrink them
+    SmallVector<TermId, INLINE_QUERY_WORD_COUNT> plus_words = query.plus_words;
+    std::sort(plus_words.begin(), plus_words.end(), [this](TermId lhs, TermId rhs) {
+        return word_to_document_freqs_[lhs].size() < word_to_document_freqs_[rhs].size();
+    });
+    word_to_document_freqs_[plus_words[0]].ForEach([&candidates](int internal_id, uint32_t) {
+        candidates.push_back(internal_id);
+    });
+    std::vector<int> ids;
+    for (size_t i = 1; i < plus_words.size() && !candidates.empty(); ++i) {
+        NarrowCandidates(word_to_document_freqs_[plus_words[i]], true, candidates, ids);
+    }
+    for (size_t i = 0; i < query.minus_words.size() && !candidates.empty(); ++i) {
+        NarrowCandidates(word_to_document_freqs_[query.minus_words[i]], false, candidates, ids);
+    }
+    return candidates;
+}
+
+void SearchServer::ExtendLogTable() {
+    // Neither the document count nor a document frequency can exceed the number of internal ids
+    while (log_table_.size() <= internal_to_external_.size()) {
+        log_table_.push_back(std::log(static_cast<double>(log_table_.size())));
+    }
+}
+
+double SearchServer::Log(size_t value) const {
+    return value < log_table_.size() ? log_table_[value] : std::log(static_cast<double>(value));
+}
+
+double SearchServer::ComputeWordInverseDocumentFreq(TermId term_id) const {
+    return Log(GetDocumentCount()) - Log(word_to_document_freqs_[term_id].size());
+}
+
+void SearchServer::ComputeInverseDocumentFreqs(Query& query) const {
+    query.inverse_document_freqs.assign(query.plus_words.size(), 0.0);
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        if (!word_to_document_freqs_[query.plus_words[i]].empty()) {
+            query.inverse_document_freqs[i] = ComputeWordInverseDocumentFreq(query.plus_words[i]);
         }
     }
-    if(isUnique) {
-        sort(result.minus_words.begin(), result.minus_words.end());
-        auto itM = unique(result.minus_words.begin(), result.minus_words.end());
-        result.minus_words.erase(itM, result.minus_words.end());
- 
-        sort(result.plus_words.begin(), result.plus_words.end());
-        auto itP = unique(result.plus_words.begin(), result.plus_words.end());
-        result.plus_words.erase(itP, result.plus_words.end());
+}
+
+void SearchServer::ComputeInverseDocumentFreqs(Query& query, const CorpusStatistics& statistics) const {
+    query.inverse_document_freqs.assign(query.plus_words.size(), 0.0);
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        if (word_to_document_freqs_[query.plus_words[i]].empty()) {
+            continue;
+        }
+        const int document_freq = statistics.document_freqs.at(dictionary_.GetTerm(query.plus_words[i]));
+        // A word left only in hidden documents scores nothing
+        if (document_freq > 0) {
+            // The same arithmetic as ComputeWordInverseDocumentFreq, so a split collection scores exactly like a whole one
+            query.inverse_document_freqs[i] = Log(statistics.document_count) - Log(document_freq);
+        }
     }
-    return result;
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view word) const {
-    return std::log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(std::basic_string(word)).size());
+void SearchServer::CollectStatistics(const std::string_view raw_query, CorpusStatistics& statistics) const {
+    CollectStatistics(raw_query, statistics, 0, [](TermId) { return 0; });
+}
+
+void SearchServer::ThrowInvalidQueryWord(std::string_view word) {
+    throw std::invalid_argument("Query word "s + std::basic_string(word) + " is invalid"s);
+}
+
+RelevanceAccumulator& SearchServer::GetThreadAccumulator() {
+    static thread_local RelevanceAccumulator accumulator;
+    return accumulator;
+}
+
+TopDocuments& SearchServer::GetThreadTopDocuments() {
+    static thread_local TopDocuments top(0);
+    return top;
 }
\ No newline at end of file
@@ -1,29 +1,63 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cmath>
 #include <iostream>
 #include <map>
+#include <optional>
 #include <set>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 #include <deque>
 #include <numeric>
 #include <execution>
 #include <thread>
+#include <limits>
+#include <memory>
 
 #include "string_processing.h"
 #include "document.h"
 #include "read_input_functions.h"
-#include "concurrent_map.h"
+#include "term_dictionary.h"
+#include "posting_list.h"
+#include "relevance_accumulator.h"
+#include "top_documents.h"
+#include "index_file.h"
+#include "small_vector.h"
+#include "word_set_fingerprint.h"
+#include "forward_index.h"
+#include "mapped_vector.h"
+#include "document_id_map.h"
 
 using std::string_literals::operator""s;
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
-constexpr double EPSILON = 1e-6;
+
+// Document counts of a collection split across several servers, so that
+// every part scores a word with the same inverse document frequency.
+// Words are views of the query text they were collected for.
+struct CorpusStatistics {
+    int document_count = 0;
+    std::map<std::string_view, int> document_freqs;
+};
+
+// Why a query was rejected
+enum class QueryError {
+    NONE,
+    // A lone "-"
+    EMPTY_MINUS_WORD,
+    // A word starting with "--"
+    DOUBLE_MINUS,
+    // A word with a control character (bytes 0-31)
+    INVALID_CHARACTER,
+};
 
 class SearchServer {
 public:
@@ -36,29 +70,88 @@ public:
 
     void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
+    // Same result as calling AddDocument for each document in order. Nothing
+    // is added if any id or word is invalid.
+    void AddDocuments(const std::vector<NewDocument>& documents);
+
+    void AddDocuments(const std::execution::sequenced_policy&, const std::vector<NewDocument>& documents);
+
+    // Tokenizes chunks of documents and fills posting lists on all cores
+    void AddDocuments(const std::execution::parallel_policy&, const std::vector<NewDocument>& documents);
+
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
-    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
 
     template <typename DocumentPredicate, typename Policy>
-    std::vector<Document> FindTopDocuments(const Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template<typename Policy>
-    std::vector<Document> FindTopDocuments(const Policy& policy, const std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const Policy& policy, const std::string_view raw_query, DocumentStatus status,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template<typename Policy>
     std::vector<Document> FindTopDocuments(const Policy& policy, const std::string_view raw_query) const;
 
+    // Same as FindTopDocuments, but an invalid query is reported through the
+    // returned code, with result left empty, instead of an exception
+    template <typename DocumentPredicate>
+    QueryError TryFindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate,
+        std::vector<Document>& result, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    QueryError TryFindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+        std::vector<Document>& result, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // Conjunctive mode: only documents containing every plus word, scored the
+    // same way as by FindTopDocuments. Candidates come from intersecting the
+    // posting lists, shortest first, rather than from scoring every posting.
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsWithAllWords(const std::string_view raw_query, DocumentPredicate document_predicate,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::vector<Document> FindTopDocumentsWithAllWords(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // Scores with the collection-wide counts instead of this server's own
+    template <typename DocumentPredicate, typename Policy>
+    std::vector<Document> FindTopDocuments(const Policy& policy, const CorpusStatistics& statistics, const std::string_view raw_query,
+        DocumentPredicate document_predicate, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template <typename Policy>
+    std::vector<Document> FindTopDocuments(const Policy& policy, const CorpusStatistics& statistics, const std::string_view raw_query,
+        DocumentStatus status, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // Adds this server's documents and the document counts of the query's plus words
+    void CollectStatistics(const std::string_view raw_query, CorpusStatistics& statistics) const;
+
+    // Copies the indexed words, status and rating of every document of other
+    // for which keep(document_id) holds, without tokenizing the text again
+    template <typename Predicate>
+    void AddDocumentsFrom(const SearchServer& other, Predicate keep);
+
+    // Changes whenever documents are added or removed
+    uint64_t GetGeneration() const;
+
     int GetDocumentCount() const;
 
-    const std::set<int>::const_iterator begin() const;
+    size_t GetTextStorageBytes() const;
+
+    DocumentIdMap::Iterator begin() const;
 
-    const std::set<int>::const_iterator end() const;
+    DocumentIdMap::Iterator end() const;
     
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    // Throws std::out_of_range for a document that was never added or was removed
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+
+    // Kept up to date as documents are added. Throws std::out_of_range for
+    // an unknown document.
+    WordSetFingerprint GetWordSetFingerprint(int document_id) const;
 
     void RemoveDocument(int document_id);
 
@@ -73,30 +166,118 @@ public:
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy&,
         const std::string_view raw_query, int document_id) const;
 
+    // Writes the whole index to a versioned, checksummed binary file. The
+    // file is replaced in one rename, so saving over the file this server
+    // was opened from is safe.
+    void Save(const std::string& path) const;
+
+    // Opens a file written by Save. Postings, words and document tables are
+    // used in place from the mapped file, so their pages are only read when
+    // something touches them, and each table is copied into memory the
+    // first time a change needs it. Checksums, and the term ids of the
+    // forward index, are checked only on request, since that reads every page.
+    static SearchServer Open(const std::string& path, bool verify = false);
+
 
 private:
-    struct DocumentData {
-        int rating;
+    friend class QueryCache;
+    friend class QueryBatch;
+    friend class NearDuplicateDetector;
+    friend class SegmentedSearchServer;
+
+    static constexpr size_t STATUS_COUNT = static_cast<size_t>(DocumentStatus::REMOVED) + 1;
+
+    const std::set<std::string, std::less<>> stop_words_;
+    TermDictionary dictionary_;
+    std::vector<PostingList> word_to_document_freqs_;
+    // Postings and the columns below refer to documents by dense internal
+    // ids, assigned in insertion order. Removed documents keep their slots.
+    MappedVector<int> internal_to_external_;
+    MappedVector<int> ratings_;
+    MappedVector<DocumentStatus> statuses_;
+    MappedVector<double> inv_word_counts_;
+    ForwardIndex forward_index_;
+    MappedVector<WordSetFingerprint> word_set_fingerprints_;
+    // One bit per internal id for each status; removed documents have none
+    std::array<MappedVector<uint64_t>, STATUS_COUNT> status_bitmaps_;
+    // Live documents only
+    DocumentIdMap document_ids_;
+    // Set when the index was opened from a file that postings and words point into
+    std::shared_ptr<const IndexFile> index_file_;
+    uint64_t generation_ = 0;
+    // log_table_[i] == log(i) for every possible document count and frequency,
+    // so an inverse document frequency costs two loads instead of a log
+    std::vector<double> log_table_;
+
+
+    std::optional<uint32_t> FindInternalId(int document_id) const;
+
+    // Like FindInternalId, but throws std::out_of_range for an unknown document
+    uint32_t GetInternalId(int document_id) const;
+
+    bool IsLive(uint32_t internal_id) const;
+
+    // Fills the columns of a new document; its postings are up to the caller
+    uint32_t AddDocumentSlot(int document_id, DocumentStatus status, int rating, double inv_word_count);
+
+    // Takes a document out of the columns; its postings are up to the caller
+    void RemoveDocumentSlot(uint32_t internal_id);
+
+    // The predicate of the status overloads. Scoring tests the bitmap of the
+    // status instead of calling it.
+    struct StatusPredicate {
         DocumentStatus status;
-        bool operator==(const DocumentData& other) {
-            return (rating == other.rating && status == other.status);
+
+        bool operator()(int, DocumentStatus document_status, int) const {
+            return document_status == status;
         }
     };
-    const std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
-    std::map<int, DocumentData> documents_;
-    std::set<int> document_ids_;
 
+    // Also rejects the documents whose bits are set in hidden, a bitmap by
+    // internal id, while keeping the fast path of the wrapped predicate
+    template <typename DocumentPredicate>
+    struct HidingPredicate {
+        DocumentPredicate document_predicate;
+        const std::atomic<uint64_t>* hidden;
+
+        bool operator()(int document_id, DocumentStatus status, int rating) const {
+            return document_predicate(document_id, status, rating);
+        }
+    };
+
+    template <typename DocumentPredicate>
+    struct IsHidingPredicate : std::false_type {};
+
+    template <typename DocumentPredicate>
+    struct IsHidingPredicate<HidingPredicate<DocumentPredicate>> : std::true_type {};
+
+    template <typename DocumentPredicate>
+    bool IsAccepted(const DocumentPredicate& document_predicate, uint32_t internal_id) const;
+
+    // CollectStatistics leaving out hidden_count documents and, for every
+    // plus word, hidden_document_freq(term_id) of the documents containing it
+    template <typename HiddenDocumentFreq>
+    void CollectStatistics(const std::string_view raw_query, CorpusStatistics& statistics, int hidden_count,
+        HiddenDocumentFreq hidden_document_freq) const;
 
     bool IsStopWord(const std::string_view word) const;
 
     static bool IsValidWord(const std::string_view word);
 
-    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view text) const;
+    // Fills words, reusing its storage, and throws on an invalid word
+    void SplitIntoWordsNoStop(const std::string_view text, std::vector<std::string_view>& words) const;
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
+    static WordSetFingerprint ComputeWordSetFingerprint(ForwardIndex::Terms terms);
+
+    static constexpr size_t MIN_BATCH_CHUNK_SIZE = 1024;
+
+    void AddDocumentBatch(const std::vector<NewDocument>& documents, size_t chunk_count);
+
+    // terms must be sorted by term id
+    void AddDocumentTerms(int document_id, ForwardIndex::Terms terms, double inv_word_count, DocumentStatus status, int rating);
+
     struct QueryWord
     {
         std::string_view data;
@@ -104,22 +285,81 @@ private:
         bool is_stop;
     };
 
-    QueryWord ParseQueryWord(const std::string_view text) const;
+    QueryError ParseQueryWord(std::string_view text, QueryWord& result) const;
+
+    [[noreturn]] static void ThrowInvalidQueryWord(std::string_view word);
+
+    // Words of typical queries fit inline, so parsing one allocates nothing
+    static constexpr size_t INLINE_QUERY_WORD_COUNT = 16;
 
     struct Query {
-        std::vector<std::string_view> plus_words;
-        std::vector<std::string_view> minus_words;
+        SmallVector<TermId, INLINE_QUERY_WORD_COUNT> plus_words;
+        SmallVector<TermId, INLINE_QUERY_WORD_COUNT> minus_words;
+        // Parallel to plus_words, zero for words no live document contains
+        SmallVector<double, INLINE_QUERY_WORD_COUNT> inverse_document_freqs;
+        // A plus word was dropped for not being in the dictionary
+        bool has_unknown_plus_word = false;
     };
 
+    // Stops at the first invalid word and leaves it in invalid_word
+    QueryError ParseQuery(const std::string_view text, bool isUnique, Query& result, std::string_view& invalid_word) const;
+
     Query ParseQuery(const std::string_view text, bool isUnique) const;
 
-    double ComputeWordInverseDocumentFreq(const std::string_view word) const;
-    
-    template <typename DocumentPredicate, typename ExecutionPolicy>
-    std::vector<Document> FindAllDocuments(const ExecutionPolicy& policy, const Query& query, DocumentPredicate document_predicate) const;
+    // Same, with find_term(word) in place of the dictionary lookup, so that a
+    // caller can resolve each distinct word once for many queries
+    template <typename FindTerm>
+    QueryError ParseQuery(const std::string_view text, bool isUnique, Query& result, std::string_view& invalid_word,
+        FindTerm find_term) const;
+
+    void ExtendLogTable();
+
+    double Log(size_t value) const;
 
+    double ComputeWordInverseDocumentFreq(TermId term_id) const;
+
+    void ComputeInverseDocumentFreqs(Query& query) const;
+
+    void ComputeInverseDocumentFreqs(Query& query, const CorpusStatistics& statistics) const;
+
+    // Shared by every query of the calling thread
+    static RelevanceAccumulator& GetThreadAccumulator();
+
+    // Shared by every sequential query of the calling thread, so that a
+    // typical query allocates nothing once it has grown
+    static TopDocuments& GetThreadTopDocuments();
+
+    template <typename DocumentPredicate, typename Policy>
+    std::vector<Document> FindTopDocumentsForQuery(const Policy& policy, const Query& query, DocumentPredicate document_predicate,
+        size_t top_count) const;
+
+    // Same, reusing the storage of result
+    template <typename DocumentPredicate, typename Policy>
+    void FindTopDocumentsForQuery(const Policy& policy, const Query& query, DocumentPredicate document_predicate,
+        size_t top_count, std::vector<Document>& result) const;
+
+    // Sums the relevances of every matching document in the accumulator of the calling thread
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
+    RelevanceAccumulator& ScoreAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
+
+    // Scores every matching document into the top of the calling thread
+    template <typename DocumentPredicate>
+    TopDocuments& ScoreTopDocuments(const Query& query, DocumentPredicate document_predicate, size_t top_count) const;
+
+    template <typename DocumentPredicate>
+    void FindTopDocumentsExhaustive(const Query& query, DocumentPredicate document_predicate, size_t top_count,
+        std::vector<Document>& result) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsConjunctive(const Query& query, DocumentPredicate document_predicate, size_t top_count) const;
+
+    // Sorted internal ids of the documents containing every plus word and no minus word
+    std::vector<int> FindConjunctiveCandidates(const Query& query) const;
+
+    static constexpr size_t MIN_SHARD_SIZE = 16 * 1024;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsSharded(const Query& query, DocumentPredicate document_predicate, size_t top_count) const;
 
 
 };
@@ -136,78 +376,113 @@ private:
 template<class Policy>
     void SearchServer::RemoveDocument(Policy&& policy, int document_id) {
 
-        SearchServer::documents_.erase(document_id);
-        SearchServer::document_ids_.erase(document_id);
-        const auto& words_freqs = document_to_word_freqs_[document_id];
-        std::vector<std::string_view> words_to_remove(words_freqs.size());
+        const auto internal_id = FindInternalId(document_id);
+        if (!internal_id) {
+            return;
+        }
+        RemoveDocumentSlot(*internal_id);
+        const ForwardIndex::Terms words_freqs = forward_index_.GetTerms(*internal_id);
+        std::vector<TermId> words_to_remove(words_freqs.size());
         std::transform(policy, words_freqs.begin(), words_freqs.end(), words_to_remove.begin(),
-            [](auto& word_and_freq) { return std::string_view{ word_and_freq.first }; });
+            [](const ForwardEntry& word_and_freq) { return word_and_freq.term_id; });
         std::for_each(policy, words_to_remove.begin(), words_to_remove.end(),
-            [this, document_id](std::string_view& word)
+            [this, internal_id](TermId term_id)
             {
-                word_to_document_freqs_[std::move(std::string{ word })].erase(document_id);
+                word_to_document_freqs_[term_id].Remove(*internal_id);
             });
-        document_to_word_freqs_.erase(document_id);
     }
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate) const {
-    
-    const auto query = ParseQuery(raw_query,true);
-
-    auto matched_documents = FindAllDocuments(query, document_predicate);
-    std::sort(matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-        if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
-            return lhs.rating > rhs.rating;
+template <typename Predicate>
+void SearchServer::AddDocumentsFrom(const SearchServer& other, Predicate keep) {
+    // Each word of other is looked up here only once
+    constexpr TermId NO_TERM = std::numeric_limits<TermId>::max();
+    std::vector<TermId> term_ids(other.dictionary_.size(), NO_TERM);
+    std::vector<ForwardEntry> entries;
+    // Internal id order keeps the postings appended in ascending order
+    for (uint32_t other_id = 0; other_id < other.internal_to_external_.size(); ++other_id) {
+        const int document_id = other.internal_to_external_[other_id];
+        if (!other.IsLive(other_id) || !keep(document_id)) {
+            continue;
         }
-        else {
-            return lhs.relevance > rhs.relevance;
+        if (document_ids_.Contains(document_id)) {
+            throw std::invalid_argument("Invalid document_id"s);
         }
+        entries.clear();
+        for (const auto [term_id, term_count] : other.forward_index_.GetTerms(other_id)) {
+            if (term_ids[term_id] == NO_TERM) {
+                term_ids[term_id] = dictionary_.Intern(other.dictionary_.GetTerm(term_id));
+            }
+            entries.push_back({ term_ids[term_id], term_count });
+        }
+        std::sort(entries.begin(), entries.end(), [](const ForwardEntry& lhs, const ForwardEntry& rhs) {
+            return lhs.term_id < rhs.term_id;
         });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+        AddDocumentTerms(document_id, { entries.data(), entries.data() + entries.size() }, other.inv_word_counts_[other_id],
+            other.statuses_[other_id], other.ratings_[other_id]);
     }
+}
 
-    return matched_documents;
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate, size_t top_count) const {
+    
+    auto query = ParseQuery(raw_query,true);
+    ComputeInverseDocumentFreqs(query);
+
+    return FindTopDocumentsForQuery(std::execution::seq, query, document_predicate, top_count);
 }
 
 template <typename DocumentPredicate, typename Policy>
-std::vector<Document> SearchServer::FindTopDocuments(const Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate) const{
+std::vector<Document> SearchServer::FindTopDocuments(const Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate, size_t top_count) const{
+
+    auto query = ParseQuery(raw_query,true);
+    ComputeInverseDocumentFreqs(query);
 
-    if  (std::is_same_v<Policy, std::execution::sequenced_policy>) {
+    return FindTopDocumentsForQuery(policy, query, document_predicate, top_count);
+}
 
-        return FindTopDocuments(raw_query, document_predicate);
+template <typename DocumentPredicate>
+QueryError SearchServer::TryFindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate,
+    std::vector<Document>& result, size_t top_count) const {
+    result.clear();
+    Query query;
+    std::string_view invalid_word;
+    if (const QueryError error = ParseQuery(raw_query, true, query, invalid_word); error != QueryError::NONE) {
+        return error;
     }
+    ComputeInverseDocumentFreqs(query);
+    FindTopDocumentsForQuery(std::execution::seq, query, document_predicate, top_count, result);
+    return QueryError::NONE;
+}
 
-    const auto query = ParseQuery(raw_query,true);
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsWithAllWords(const std::string_view raw_query, DocumentPredicate document_predicate,
+    size_t top_count) const {
 
-    auto matched_documents = FindAllDocuments(std::execution::par, query, document_predicate);
+    auto query = ParseQuery(raw_query, true);
+    ComputeInverseDocumentFreqs(query);
 
-    std::sort(std::execution::par, matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-        const auto fault = std::abs(lhs.relevance - rhs.relevance);
-        if (fault < EPSILON) {
-            return lhs.rating > rhs.rating;
-        }
-        else {
-            return lhs.relevance > rhs.relevance;
-        }
-        });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
+    return FindTopDocumentsConjunctive(query, document_predicate, top_count);
+}
+
+template <typename DocumentPredicate, typename Policy>
+std::vector<Document> SearchServer::FindTopDocuments(const Policy& policy, const CorpusStatistics& statistics, const std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t top_count) const {
+
+    auto query = ParseQuery(raw_query, true);
+    ComputeInverseDocumentFreqs(query, statistics);
+
+    return FindTopDocumentsForQuery(policy, query, document_predicate, top_count);
+}
 
-    return matched_documents;
+template <typename Policy>
+std::vector<Document> SearchServer::FindTopDocuments(const Policy& policy, const CorpusStatistics& statistics, const std::string_view raw_query,
+    DocumentStatus status, size_t top_count) const {
+    return FindTopDocuments(policy, statistics, raw_query, StatusPredicate{ status }, top_count);
 }
 
 template<typename Policy>
-std::vector<Document> SearchServer::FindTopDocuments(const Policy& policy, const std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(
-    policy,
-    raw_query,
-    [status](int document_id, DocumentStatus document_status, int rating) 
-    {
-        return document_status == status;
-    });
+std::vector<Document> SearchServer::FindTopDocuments(const Policy& policy, const std::string_view raw_query, DocumentStatus status, size_t top_count) const {
+    return FindTopDocuments(policy, raw_query, StatusPredicate{ status }, top_count);
 }
 
 template<typename Policy>
@@ -218,74 +493,225 @@ std::vector<Document> SearchServer::FindTopDocuments(const Policy& policy, const
 
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const SearchServer::Query& query, DocumentPredicate document_predicate) const {
-    std::map<int, double> document_to_relevance;
-    for (const std::string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(std::basic_string(word)) == 0) {
-            continue;
+bool SearchServer::IsAccepted(const DocumentPredicate& document_predicate, uint32_t internal_id) const {
+    if constexpr (std::is_same_v<DocumentPredicate, StatusPredicate>) {
+        const MappedVector<uint64_t>& bitmap = status_bitmaps_[static_cast<size_t>(document_predicate.status)];
+        return (bitmap[internal_id / 64] >> (internal_id % 64)) & 1;
+    }
+    else if constexpr (IsHidingPredicate<DocumentPredicate>::value) {
+        const uint64_t hidden = document_predicate.hidden[internal_id / 64].load(std::memory_order_relaxed);
+        return !((hidden >> (internal_id % 64)) & 1) && IsAccepted(document_predicate.document_predicate, internal_id);
+    }
+    else {
+        return document_predicate(internal_to_external_[internal_id], statuses_[internal_id], ratings_[internal_id]);
+    }
+}
+
+template <typename HiddenDocumentFreq>
+void SearchServer::CollectStatistics(const std::string_view raw_query, CorpusStatistics& statistics, int hidden_count,
+    HiddenDocumentFreq hidden_document_freq) const {
+    statistics.document_count += GetDocumentCount() - hidden_count;
+    // A repeated word is scored once, so it's counted once
+    std::vector<std::string_view> counted_words;
+    ForEachWord(raw_query, [&](const std::string_view word) {
+        QueryWord query_word;
+        if (ParseQueryWord(word, query_word) != QueryError::NONE) {
+            ThrowInvalidQueryWord(word);
         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(std::basic_string(word))) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
-            }
+        if (query_word.is_stop || query_word.is_minus
+            || std::find(counted_words.begin(), counted_words.end(), query_word.data) != counted_words.end()) {
+            return true;
         }
-    }
+        counted_words.push_back(query_word.data);
+        int& document_freq = statistics.document_freqs[query_word.data];
+        if (const auto term_id = dictionary_.Find(query_word.data)) {
+            document_freq += static_cast<int>(word_to_document_freqs_[*term_id].size()) - hidden_document_freq(*term_id);
+        }
+        return true;
+    });
+}
 
-    for (const std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(std::basic_string(word)) == 0) {
-            continue;
+template <typename FindTerm>
+QueryError SearchServer::ParseQuery(const std::string_view text, bool isUnique, Query& result, std::string_view& invalid_word,
+    FindTerm find_term) const {
+    QueryError error = QueryError::NONE;
+    ForEachWord(text, [&](const std::string_view word) {
+        QueryWord query_word;
+        error = ParseQueryWord(word, query_word);
+        if (error != QueryError::NONE) {
+            invalid_word = word;
+            return false;
         }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(std::basic_string(word))) {
-            document_to_relevance.erase(document_id);
+        if (query_word.is_stop) {
+            return true;
         }
+        // Words that never occurred in any document can't affect the result
+        const std::optional<TermId> term_id = find_term(query_word.data);
+        if (!term_id) {
+            result.has_unknown_plus_word |= !query_word.is_minus;
+            return true;
+        }
+        if (query_word.is_minus) {
+            result.minus_words.emplace_back(*term_id);
+        }
+        else 
+        {
+            result.plus_words.emplace_back(*term_id);
+        }
+        return true;
+    });
+    if (error != QueryError::NONE) {
+        return error;
     }
-
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+    if(isUnique) {
+        std::sort(result.minus_words.begin(), result.minus_words.end());
+        auto itM = std::unique(result.minus_words.begin(), result.minus_words.end());
+        result.minus_words.resize(itM - result.minus_words.begin());
+ 
+        std::sort(result.plus_words.begin(), result.plus_words.end());
+        auto itP = std::unique(result.plus_words.begin(), result.plus_words.end());
+        result.plus_words.resize(itP - result.plus_words.begin());
     }
-    return matched_documents;
+    return QueryError::NONE;
 }
 
 template <typename DocumentPredicate, typename Policy>
-std::vector<Document> SearchServer::FindAllDocuments(const Policy& policy, const SearchServer::Query& query, DocumentPredicate document_predicate) const {
+std::vector<Document> SearchServer::FindTopDocumentsForQuery(const Policy& policy, const SearchServer::Query& query, DocumentPredicate document_predicate,
+    size_t top_count) const {
+    std::vector<Document> result;
+    FindTopDocumentsForQuery(policy, query, document_predicate, top_count, result);
+    return result;
+}
 
-    if (std::is_same_v<Policy, std::execution::sequenced_policy>) {
+template <typename DocumentPredicate, typename Policy>
+void SearchServer::FindTopDocumentsForQuery(const Policy&, const SearchServer::Query& query, DocumentPredicate document_predicate,
+    size_t top_count, std::vector<Document>& result) const {
 
-        return FindAllDocuments(query, document_predicate);
+    if constexpr (std::is_same_v<Policy, std::execution::sequenced_policy>) {
+        FindTopDocumentsExhaustive(query, document_predicate, top_count, result);
     }
-    ConcurrentMap<int, double> document_to_relevance(std::thread::hardware_concurrency());
-    std::for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(),
-        [this, &document_to_relevance,document_predicate](std::string_view word) {
-            if (word_to_document_freqs_.count(std::basic_string(word)) == 0) {
-               
-            }
-            else {
-                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                for (const auto [document_id, term_freq] : word_to_document_freqs_.at(std::basic_string(word))) {
-                    DocumentData document_data;
-                    document_data = documents_.at(document_id);
-                    if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                        document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-                    }
-                }
-            }
+    else {
+        result = FindTopDocumentsSharded(query, document_predicate, top_count);
+    }
+}
+
+template <typename DocumentPredicate>
+RelevanceAccumulator& SearchServer::ScoreAllDocuments(const SearchServer::Query& query, DocumentPredicate document_predicate) const {
+    RelevanceAccumulator& accumulator = GetThreadAccumulator();
+    accumulator.Reset(internal_to_external_.size());
+
+    for (const TermId term_id : query.minus_words) {
+        word_to_document_freqs_[term_id].ForEach([&accumulator](int internal_id, uint32_t) {
+            accumulator.Exclude(internal_id);
         });
-    auto document_to_relevance_ = document_to_relevance.BuildOrdinaryMap();
-    for (const std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(std::basic_string(word)) == 0) {
+    }
+
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        const TermId term_id = query.plus_words[i];
+        if (word_to_document_freqs_[term_id].empty()) {
             continue;
         }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(std::basic_string(word))) {
-            document_to_relevance_.erase(document_id);
+        const double inverse_document_freq = query.inverse_document_freqs[i];
+        word_to_document_freqs_[term_id].ForEach([&](int internal_id, uint32_t term_count) {
+            if (!accumulator.IsExcluded(internal_id) && IsAccepted(document_predicate, internal_id)) {
+                accumulator.Add(internal_id, term_count * inv_word_counts_[internal_id] * inverse_document_freq);
+            }
+        });
+    }
+    return accumulator;
+}
+
+template <typename DocumentPredicate>
+TopDocuments& SearchServer::ScoreTopDocuments(const SearchServer::Query& query, DocumentPredicate document_predicate,
+    size_t top_count) const {
+    TopDocuments& top = GetThreadTopDocuments();
+    top.Reset(top_count);
+    ScoreAllDocuments(query, document_predicate).ForEach([&](uint32_t internal_id, double relevance) {
+        top.Push({ internal_to_external_[internal_id], relevance, ratings_[internal_id] });
+    });
+    return top;
+}
+
+template <typename DocumentPredicate>
+void SearchServer::FindTopDocumentsExhaustive(const SearchServer::Query& query, DocumentPredicate document_predicate, size_t top_count,
+    std::vector<Document>& result) const {
+    ScoreTopDocuments(query, document_predicate, top_count).Extract(result);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsSharded(const SearchServer::Query& query, DocumentPredicate document_predicate, size_t top_count) const {
+    // Shards are ranges of internal ids; each one is scored into the dense
+    // accumulator of the thread that runs it, with no shared state to lock
+    const size_t document_slot_count = internal_to_external_.size();
+    const size_t max_shard_count = std::max(1u, std::thread::hardware_concurrency()) * 4;
+    const size_t shard_count = std::clamp<size_t>(document_slot_count / MIN_SHARD_SIZE, 1, max_shard_count);
+    const size_t shard_size = (document_slot_count + shard_count - 1) / shard_count;
+
+    std::vector<TopDocuments> shard_tops(shard_count, TopDocuments(top_count));
+    std::vector<size_t> shards(shard_count);
+    std::iota(shards.begin(), shards.end(), 0);
+    std::for_each(std::execution::par, shards.begin(), shards.end(), [&](size_t shard) {
+        const int first = static_cast<int>(std::min(document_slot_count, shard * shard_size));
+        const int last = static_cast<int>(std::min(document_slot_count, (shard + 1) * shard_size));
+        const auto for_each_in_shard = [first, last](const PostingList& postings, auto function) {
+            PostingList::Cursor cursor(postings);
+            for (cursor.SkipTo(first); !cursor.AtEnd() && cursor.GetDocumentId() < last; cursor.Next()) {
+                function(cursor.GetDocumentId(), cursor.GetTermCount());
+            }
+        };
+
+        RelevanceAccumulator& accumulator = GetThreadAccumulator();
+        accumulator.Reset(last - first);
+        for (const TermId term_id : query.minus_words) {
+            for_each_in_shard(word_to_document_freqs_[term_id], [&](int internal_id, uint32_t) {
+                accumulator.Exclude(internal_id - first);
+            });
+        }
+        for (size_t i = 0; i < query.plus_words.size(); ++i) {
+            const double inverse_document_freq = query.inverse_document_freqs[i];
+            for_each_in_shard(word_to_document_freqs_[query.plus_words[i]], [&](int internal_id, uint32_t term_count) {
+                if (!accumulator.IsExcluded(internal_id - first) && IsAccepted(document_predicate, internal_id)) {
+                    accumulator.Add(internal_id - first, term_count * inv_word_counts_[internal_id] * inverse_document_freq);
+                }
+            });
         }
+        accumulator.ForEach([&](uint32_t slot, double relevance) {
+            shard_tops[shard].Push({ internal_to_external_[first + slot], relevance, ratings_[first + slot] });
+        });
+    });
+
+    TopDocuments top(top_count);
+    for (const TopDocuments& shard_top : shard_tops) {
+        top.Merge(shard_top);
     }
+    return top.Extract();
+}
 
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance_) {
-        matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsConjunctive(const SearchServer::Query& query, DocumentPredicate document_predicate,
+    size_t top_count) const {
+    const std::vector<int> candidates = FindConjunctiveCandidates(query);
+    if (candidates.empty() || top_count == 0) {
+        return {};
     }
-    return matched_documents;
-}
\ No newline at end of file
+    // Every candidate is in every list, so the cursors only ever move forward
+    // onto it; contributions are summed in query order as in ScoreAllDocuments
+    std::vector<PostingList::Cursor> cursors;
+    cursors.reserve(query.plus_words.size());
+    for (const TermId term_id : query.plus_words) {
+        cursors.emplace_back(word_to_document_freqs_[term_id]);
+    }
+    TopDocuments top(top_count);
+    for (const int internal_id : candidates) {
+        if (!IsAccepted(document_predicate, internal_id)) {
+            continue;
+        }
+        double relevance = 0.0;
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            cursors[i].SkipTo(internal_id);
+            relevance += cursors[i].GetTermCount() * inv_word_counts_[internal_id] * query.inverse_document_freqs[i];
+        }
+        top.Push({ internal_to_external_[internal_id], relevance, ratings_[internal_id] });
+    }
+    return top.Extract();
+}
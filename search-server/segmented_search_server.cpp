@@ -0,0 +1,242 @@
+#include "segmented_search_server.h"
+
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+using std::string_literals::operator""s;
+
+SegmentedSearchServer::SegmentedSearchServer(const std::string& stop_words_text, size_t buffer_capacity)
+    : SegmentedSearchServer(std::string_view(stop_words_text), buffer_capacity)
+{
+}
+
+SegmentedSearchServer::SegmentedSearchServer(const std::string_view stop_words_text, size_t buffer_capacity)
+    : SegmentedSearchServer(SplitIntoWords(stop_words_text), buffer_capacity)
+{
+}
+
+SegmentedSearchServer::~SegmentedSearchServer() {
+    {
+        std::lock_guard guard(merge_mutex_);
+        stopping_ = true;
+    }
+    merge_wakeup_.notify_one();
+    merge_thread_.join();
+}
+
+void SegmentedSearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+    std::unique_lock guard(mutex_);
+    if (document_id < 0 || document_ids_.count(document_id) > 0) {
+        throw std::invalid_argument("Invalid document_id"s);
+    }
+    if (!SearchServer::IsValidWord(document)) {
+        // Throws the error AddDocument would have
+        std::vector<std::string_view> words;
+        buffer_->SplitIntoWordsNoStop(document, words);
+    }
+    pending_texts_.emplace_back(document);
+    pending_.push_back({ document_id, pending_texts_.back(), status, ratings });
+    document_ids_.insert(document_id);
+    if (pending_.size() >= batch_size_) {
+        IndexPendingDocuments();
+    }
+    if (static_cast<size_t>(buffer_->GetDocumentCount()) + pending_.size() < buffer_capacity_) {
+        return;
+    }
+    SealBuffer();
+    guard.unlock();
+    RequestMerge();
+}
+
+void SegmentedSearchServer::RemoveDocument(int document_id) {
+    std::unique_lock guard(mutex_);
+    if (document_ids_.erase(document_id) == 0) {
+        return;
+    }
+    for (const auto& segment : *segments_) {
+        if (!segment->Hide(document_id)) {
+            continue;
+        }
+        // Only a mostly deleted segment needs a merge
+        if (segment->hidden_count * 2 > segment->index->GetDocumentCount()) {
+            guard.unlock();
+            RequestMerge();
+        }
+        return;
+    }
+    IndexPendingDocuments();
+    buffer_->RemoveDocument(document_id);
+}
+
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status, size_t top_count) const {
+    return FindTopDocuments(raw_query, SearchServer::StatusPredicate{ status }, top_count);
+}
+
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(const std::string_view raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+int SegmentedSearchServer::GetDocumentCount() const {
+    std::shared_lock guard(mutex_);
+    return static_cast<int>(document_ids_.size());
+}
+
+size_t SegmentedSearchServer::GetSegmentCount() const {
+    std::shared_lock guard(mutex_);
+    return segments_->size();
+}
+
+void SegmentedSearchServer::Flush() {
+    {
+        std::lock_guard guard(mutex_);
+        SealBuffer();
+    }
+    RequestMerge();
+}
+
+void SegmentedSearchServer::WaitForMerges() {
+    std::unique_lock lock(merge_mutex_);
+    merge_idle_.wait(lock, [this] { return !merge_requested_ && !merging_; });
+}
+
+void SegmentedSearchServer::IndexPendingDocuments() const {
+    if (pending_.empty()) {
+        return;
+    }
+    buffer_->AddDocuments(std::execution::par, pending_);
+    pending_.clear();
+    pending_texts_.clear();
+}
+
+void SegmentedSearchServer::SealBuffer() {
+    IndexPendingDocuments();
+    if (buffer_->GetDocumentCount() == 0) {
+        return;
+    }
+    std::shared_ptr<const SearchServer> index = std::move(buffer_);
+    buffer_ = std::make_unique<SearchServer>(stop_words_);
+    auto segments = std::make_shared<Segments>(*segments_);
+    segments->push_back(std::make_shared<Segment>(std::move(index), 0));
+    segments_ = std::move(segments);
+}
+
+void SegmentedSearchServer::RequestMerge() {
+    {
+        std::lock_guard guard(merge_mutex_);
+        merge_requested_ = true;
+    }
+    merge_wakeup_.notify_one();
+}
+
+void SegmentedSearchServer::RunMerges() {
+    std::unique_lock lock(merge_mutex_);
+    while (true) {
+        merge_wakeup_.wait(lock, [this] { return merge_requested_ || stopping_; });
+        if (stopping_) {
+            return;
+        }
+        merge_requested_ = false;
+        merging_ = true;
+        lock.unlock();
+        for (MergeJob job = PickMergeJob(); !job.sources.empty() && !stopping_; job = PickMergeJob()) {
+            Merge(job);
+        }
+        lock.lock();
+        merging_ = false;
+        merge_idle_.notify_all();
+    }
+}
+
+SegmentedSearchServer::MergeJob SegmentedSearchServer::PickMergeJob() const {
+    std::shared_lock guard(mutex_);
+    MergeJob job;
+    std::map<int, std::vector<std::shared_ptr<Segment>>> levels;
+    for (const auto& segment : *segments_) {
+        auto& level = levels[segment->level];
+        level.push_back(segment);
+        if (level.size() == MERGE_FACTOR) {
+            job.sources = std::move(level);
+            job.level = segment->level + 1;
+            break;
+        }
+    }
+    if (job.sources.empty()) {
+        for (const auto& segment : *segments_) {
+            if (segment->hidden_count * 2 > segment->index->GetDocumentCount()) {
+                job.sources = { segment };
+                job.level = segment->level;
+                break;
+            }
+        }
+    }
+    // Removals take the lock exclusively, so the bits can't change meanwhile
+    for (const auto& source : job.sources) {
+        job.hidden.emplace_back(source->hidden.begin(), source->hidden.end());
+    }
+    return job;
+}
+
+void SegmentedSearchServer::Merge(const MergeJob& job) {
+    // The new segment is built without holding the lock from sources that
+    // nobody modifies; only removals made meanwhile have to be carried over
+    auto index = std::make_shared<SearchServer>(stop_words_);
+    for (size_t i = 0; i < job.sources.size(); ++i) {
+        const Segment& source = *job.sources[i];
+        const std::vector<uint64_t>& hidden = job.hidden[i];
+        index->AddDocumentsFrom(*source.index, [&source, &hidden](int document_id) {
+            const uint32_t internal_id = source.index->GetInternalId(document_id);
+            return !((hidden[internal_id / 64] >> (internal_id % 64)) & 1);
+        });
+    }
+    auto merged = std::make_shared<Segment>(std::move(index), job.level);
+
+    std::lock_guard guard(mutex_);
+    for (size_t i = 0; i < job.sources.size(); ++i) {
+        const Segment& source = *job.sources[i];
+        for (size_t word = 0; word < source.hidden.size(); ++word) {
+            for (uint64_t bits = source.hidden[word] & ~job.hidden[i][word]; bits != 0; bits &= bits - 1) {
+                const uint32_t internal_id = static_cast<uint32_t>(word * 64 + __builtin_ctzll(bits));
+                merged->Hide(source.index->internal_to_external_[internal_id]);
+            }
+        }
+    }
+    auto segments = std::make_shared<Segments>();
+    for (const auto& segment : *segments_) {
+        if (std::find(job.sources.begin(), job.sources.end(), segment) == job.sources.end()) {
+            segments->push_back(segment);
+        }
+    }
+    if (merged->GetDocumentCount() > 0) {
+        segments->push_back(std::move(merged));
+    }
+    segments_ = std::move(segments);
+}
+
+SegmentedSearchServer::Segment::Segment(std::shared_ptr<const SearchServer> segment_index, int segment_level)
+    : index(std::move(segment_index))
+    , hidden((index->internal_to_external_.size() + 63) / 64)
+    , hidden_document_freqs(index->word_to_document_freqs_.size())
+    , level(segment_level)
+{
+}
+
+bool SegmentedSearchServer::Segment::Hide(int document_id) {
+    const auto internal_id = index->FindInternalId(document_id);
+    if (!internal_id) {
+        return false;
+    }
+    const uint64_t bit = uint64_t{ 1 } << (*internal_id % 64);
+    if (hidden[*internal_id / 64].fetch_or(bit) & bit) {
+        return false;
+    }
+    for (const auto [term_id, term_count] : index->forward_index_.GetTerms(*internal_id)) {
+        ++hidden_document_freqs[term_id];
+    }
+    ++hidden_count;
+    return true;
+}
+
+int SegmentedSearchServer::Segment::GetDocumentCount() const {
+    return index->GetDocumentCount() - hidden_count;
+}
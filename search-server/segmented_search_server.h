@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <execution>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+#include "top_documents.h"
+
+// Log-structured index. New documents are indexed in batches, with
+// AddDocuments on all cores, into a small write buffer that is sealed into an
+// immutable segment once it fills up; queries index a pending batch first,
+// then fan out across the buffer and every segment and merge the partial
+// tops. Removed documents of a segment are only hidden until a background
+// thread merges segments of the same level, or rewrites a segment that is
+// mostly deleted. Hidden documents are left out of the counts words are
+// scored with, so results match a single SearchServer with the same documents.
+// Batching only pays off with several cores; on one, adding a document costs
+// about as much as adding it to a SearchServer, and merges compete with it.
+class SegmentedSearchServer {
+public:
+    static constexpr size_t DEFAULT_BUFFER_CAPACITY = 16384;
+    // Segments of one level merged at a time
+    static constexpr size_t MERGE_FACTOR = 8;
+
+    template <typename StringContainer>
+    explicit SegmentedSearchServer(const StringContainer& stop_words, size_t buffer_capacity = DEFAULT_BUFFER_CAPACITY);
+
+    explicit SegmentedSearchServer(const std::string& stop_words_text, size_t buffer_capacity = DEFAULT_BUFFER_CAPACITY);
+
+    explicit SegmentedSearchServer(const std::string_view stop_words_text, size_t buffer_capacity = DEFAULT_BUFFER_CAPACITY);
+
+    SegmentedSearchServer(const SegmentedSearchServer&) = delete;
+    SegmentedSearchServer& operator=(const SegmentedSearchServer&) = delete;
+
+    ~SegmentedSearchServer();
+
+    void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    void RemoveDocument(int document_id);
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
+
+    // Searches the segments with the given policy
+    template <typename DocumentPredicate, typename Policy>
+    std::vector<Document> FindTopDocuments(const Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    int GetDocumentCount() const;
+
+    size_t GetSegmentCount() const;
+
+    // Seals the write buffer into a segment even if it isn't full
+    void Flush();
+
+    // Blocks until the merge thread has nothing left to do
+    void WaitForMerges();
+
+private:
+    // Immutable apart from the removed documents, which stay in index,
+    // hidden, until the segment is merged
+    struct Segment {
+        std::shared_ptr<const SearchServer> index;
+        // One bit per internal id of index, scored like a status bitmap
+        std::vector<std::atomic<uint64_t>> hidden;
+        // Hidden documents containing each term of index
+        std::vector<std::atomic<int>> hidden_document_freqs;
+        std::atomic<int> hidden_count = 0;
+        int level = 0;
+
+        Segment(std::shared_ptr<const SearchServer> segment_index, int segment_level);
+
+        // Returns false if index doesn't have the document or it's hidden already
+        bool Hide(int document_id);
+
+        int GetDocumentCount() const;
+    };
+
+    // Replaced as a whole whenever a segment is added or merged
+    using Segments = std::vector<std::shared_ptr<Segment>>;
+
+    struct MergeJob {
+        std::vector<std::shared_ptr<Segment>> sources;
+        // Hidden bitmap of every source when the job was picked
+        std::vector<std::vector<uint64_t>> hidden;
+        int level = 0;
+    };
+
+    const std::vector<std::string> stop_words_;
+    const size_t buffer_capacity_;
+    // Documents indexed into the buffer at a time: one AddDocuments chunk per
+    // core, which also bounds the work of a query that has to index them
+    const size_t batch_size_;
+
+    // Guards buffer_, the pending batch, segments_ and document_ids_. Queries
+    // hold it shared only while they search the buffer, or exclusively if
+    // they have to index the pending batch first.
+    mutable std::shared_mutex mutex_;
+    std::unique_ptr<SearchServer> buffer_;
+    // Added documents not yet in buffer_, already checked to be valid. The
+    // texts are owned here; a deque keeps the views of pending_ valid.
+    mutable std::vector<NewDocument> pending_;
+    mutable std::deque<std::string> pending_texts_;
+    std::shared_ptr<const Segments> segments_;
+    // Ids of every live document, in the buffer or in a segment
+    std::unordered_set<int> document_ids_;
+
+    std::mutex merge_mutex_;
+    std::condition_variable merge_wakeup_;
+    std::condition_variable merge_idle_;
+    bool merge_requested_ = false;
+    bool merging_ = false;
+    std::atomic<bool> stopping_ = false;
+    // Started last, after everything it reads
+    std::thread merge_thread_;
+
+    // Indexes the pending batch into buffer_; called with mutex_ held exclusively
+    void IndexPendingDocuments() const;
+
+    void SealBuffer();
+
+    void RequestMerge();
+
+    void RunMerges();
+
+    MergeJob PickMergeJob() const;
+
+    void Merge(const MergeJob& job);
+
+};
+
+template <typename StringContainer>
+SegmentedSearchServer::SegmentedSearchServer(const StringContainer& stop_words, size_t buffer_capacity)
+    : stop_words_(std::begin(stop_words), std::end(stop_words))
+    , buffer_capacity_(buffer_capacity > 0 ? buffer_capacity : 1)
+    , batch_size_(std::max(1u, std::thread::hardware_concurrency()) * SearchServer::MIN_BATCH_CHUNK_SIZE)
+    , buffer_(std::make_unique<SearchServer>(stop_words_))
+    , segments_(std::make_shared<const Segments>())
+    , merge_thread_([this] { RunMerges(); })
+{
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate,
+    size_t top_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, top_count);
+}
+
+template <typename DocumentPredicate, typename Policy>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(const Policy& policy, const std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t top_count) const {
+    CorpusStatistics statistics;
+    std::shared_ptr<const Segments> segments;
+    TopDocuments top(top_count);
+    {
+        std::shared_lock guard(mutex_);
+        std::unique_lock<std::shared_mutex> exclusive_guard;
+        if (!pending_.empty()) {
+            guard.unlock();
+            exclusive_guard = std::unique_lock(mutex_);
+            IndexPendingDocuments();
+        }
+        segments = segments_;
+        buffer_->CollectStatistics(raw_query, statistics);
+        for (const auto& segment : *segments) {
+            segment->index->CollectStatistics(raw_query, statistics, segment->hidden_count.load(),
+                [&segment](TermId term_id) { return segment->hidden_document_freqs[term_id].load(); });
+        }
+        for (const Document& document : buffer_->FindTopDocuments(std::execution::seq, statistics, raw_query,
+            document_predicate, top_count)) {
+            top.Push(document);
+        }
+    }
+
+    std::vector<std::vector<Document>> segment_tops(segments->size());
+    std::vector<size_t> positions(segments->size());
+    for (size_t i = 0; i < positions.size(); ++i) {
+        positions[i] = i;
+    }
+    std::for_each(policy, positions.begin(), positions.end(), [&](size_t i) {
+        const Segment& segment = *(*segments)[i];
+        segment_tops[i] = segment.index->FindTopDocuments(std::execution::seq, statistics, raw_query,
+            SearchServer::HidingPredicate<DocumentPredicate>{ document_predicate, segment.hidden.data() }, top_count);
+    });
+    for (const std::vector<Document>& segment_top : segment_tops) {
+        for (const Document& document : segment_top) {
+            top.Push(document);
+        }
+    }
+    return top.Extract();
+}
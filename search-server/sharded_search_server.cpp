@@ -0,0 +1,214 @@
+#include "sharded_search_server.h"
+
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+#include "top_documents.h"
+
+using std::string_literals::operator""s;
+
+namespace {
+
+// Waits for every future before the caller takes any result, so that no
+// shard still uses the caller's arguments once one of them has thrown
+template <typename T>
+void WaitAll(const std::vector<std::future<T>>& futures) {
+    for (const std::future<T>& future : futures) {
+        future.wait();
+    }
+}
+
+}
+
+template <typename Function>
+auto LocalSearchShard::Post(Function function) -> std::future<decltype(function(*search_server_))> {
+    using Result = decltype(function(*search_server_));
+    // std::function needs a copyable target, and a packaged_task isn't one
+    auto task = std::make_shared<std::packaged_task<Result()>>([this, function = std::move(function)]() mutable {
+        return function(*search_server_);
+    });
+    std::future<Result> result = task->get_future();
+    {
+        std::lock_guard guard(mutex_);
+        tasks_.push_back([task] { (*task)(); });
+    }
+    wakeup_.notify_one();
+    return result;
+}
+
+LocalSearchShard::LocalSearchShard(const std::string_view stop_words_text)
+    : thread_([this] { Run(); })
+{
+    // Built on the shard's thread, like everything the index allocates later
+    std::packaged_task<void()> create([this, stop_words_text] {
+        search_server_ = std::make_unique<SearchServer>(stop_words_text);
+    });
+    std::future<void> created = create.get_future();
+    {
+        std::lock_guard guard(mutex_);
+        tasks_.push_back([&create] { create(); });
+    }
+    wakeup_.notify_one();
+    try {
+        created.get();
+    } catch (...) {
+        Stop();
+        throw;
+    }
+}
+
+LocalSearchShard::~LocalSearchShard() {
+    Stop();
+}
+
+std::future<void> LocalSearchShard::AddDocuments(std::vector<NewDocument> documents) {
+    return Post([documents = std::move(documents)](SearchServer& search_server) {
+        search_server.AddDocuments(documents);
+    });
+}
+
+std::future<void> LocalSearchShard::RemoveDocument(int document_id) {
+    return Post([document_id](SearchServer& search_server) {
+        search_server.RemoveDocument(document_id);
+    });
+}
+
+std::future<int> LocalSearchShard::GetDocumentCount() {
+    return Post([](SearchServer& search_server) {
+        return search_server.GetDocumentCount();
+    });
+}
+
+std::future<CorpusStatistics> LocalSearchShard::CollectStatistics(const std::string_view raw_query) {
+    return Post([raw_query](SearchServer& search_server) {
+        CorpusStatistics statistics;
+        search_server.CollectStatistics(raw_query, statistics);
+        return statistics;
+    });
+}
+
+std::future<std::vector<Document>> LocalSearchShard::FindTopDocuments(const CorpusStatistics& statistics,
+    const std::string_view raw_query, DocumentStatus status, size_t top_count) {
+    return Post([&statistics, raw_query, status, top_count](SearchServer& search_server) {
+        return search_server.FindTopDocuments(std::execution::seq, statistics, raw_query, status, top_count);
+    });
+}
+
+void LocalSearchShard::Stop() {
+    {
+        std::lock_guard guard(mutex_);
+        stopping_ = true;
+    }
+    wakeup_.notify_one();
+    thread_.join();
+}
+
+void LocalSearchShard::Run() {
+    std::unique_lock lock(mutex_);
+    while (true) {
+        wakeup_.wait(lock, [this] { return !tasks_.empty() || stopping_; });
+        if (tasks_.empty()) {
+            return;
+        }
+        std::function<void()> task = std::move(tasks_.front());
+        tasks_.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+
+ShardedSearchServer::ShardedSearchServer(const std::string_view stop_words_text, size_t shard_count) {
+    if (shard_count == 0) {
+        throw std::invalid_argument("Shard count must be positive"s);
+    }
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.push_back(std::make_unique<LocalSearchShard>(stop_words_text));
+    }
+}
+
+ShardedSearchServer::ShardedSearchServer(std::vector<std::unique_ptr<SearchShard>> shards)
+    : shards_(std::move(shards))
+{
+    if (shards_.empty()) {
+        throw std::invalid_argument("Shard count must be positive"s);
+    }
+}
+
+void ShardedSearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+    shards_[GetShardIndex(document_id)]->AddDocuments({ NewDocument{ document_id, document, status, ratings } }).get();
+}
+
+void ShardedSearchServer::AddDocuments(const std::vector<NewDocument>& documents) {
+    std::vector<std::vector<NewDocument>> parts(shards_.size());
+    for (const NewDocument& document : documents) {
+        parts[GetShardIndex(document.id)].push_back(document);
+    }
+    std::vector<std::future<void>> futures;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        if (!parts[i].empty()) {
+            futures.push_back(shards_[i]->AddDocuments(std::move(parts[i])));
+        }
+    }
+    WaitAll(futures);
+    for (std::future<void>& future : futures) {
+        future.get();
+    }
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    shards_[GetShardIndex(document_id)]->RemoveDocument(document_id).get();
+}
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+    size_t top_count) const {
+    std::vector<std::future<CorpusStatistics>> statistics_futures;
+    for (const auto& shard : shards_) {
+        statistics_futures.push_back(shard->CollectStatistics(raw_query));
+    }
+    WaitAll(statistics_futures);
+    CorpusStatistics statistics;
+    for (std::future<CorpusStatistics>& future : statistics_futures) {
+        const CorpusStatistics shard_statistics = future.get();
+        statistics.document_count += shard_statistics.document_count;
+        for (const auto& [word, document_freq] : shard_statistics.document_freqs) {
+            statistics.document_freqs[word] += document_freq;
+        }
+    }
+
+    std::vector<std::future<std::vector<Document>>> top_futures;
+    for (const auto& shard : shards_) {
+        top_futures.push_back(shard->FindTopDocuments(statistics, raw_query, status, top_count));
+    }
+    WaitAll(top_futures);
+    TopDocuments top(top_count);
+    for (std::future<std::vector<Document>>& future : top_futures) {
+        for (const Document& document : future.get()) {
+            top.Push(document);
+        }
+    }
+    return top.Extract();
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    std::vector<std::future<int>> futures;
+    for (const auto& shard : shards_) {
+        futures.push_back(shard->GetDocumentCount());
+    }
+    int document_count = 0;
+    for (std::future<int>& future : futures) {
+        document_count += future.get();
+    }
+    return document_count;
+}
+
+size_t ShardedSearchServer::GetShardCount() const {
+    return shards_.size();
+}
+
+size_t ShardedSearchServer::GetShardIndex(int document_id) const {
+    // Fibonacci hashing spreads runs of consecutive ids over every shard
+    const uint64_t hash = static_cast<uint32_t>(document_id) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>(hash >> 32) % shards_.size();
+}
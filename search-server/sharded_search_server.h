@@ -0,0 +1,116 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+// One partition of a ShardedSearchServer. Every call returns a future and
+// takes plain data, with no predicates, so a shard in another process can
+// implement it later. Arguments passed by reference, and the query text
+// that CorpusStatistics words point into, must outlive the future.
+class SearchShard {
+public:
+    virtual ~SearchShard() = default;
+
+    virtual std::future<void> AddDocuments(std::vector<NewDocument> documents) = 0;
+
+    virtual std::future<void> RemoveDocument(int document_id) = 0;
+
+    virtual std::future<int> GetDocumentCount() = 0;
+
+    // Counts of this shard for the query's plus words
+    virtual std::future<CorpusStatistics> CollectStatistics(const std::string_view raw_query) = 0;
+
+    // Top documents scored with the given collection-wide counts
+    virtual std::future<std::vector<Document>> FindTopDocuments(const CorpusStatistics& statistics,
+        const std::string_view raw_query, DocumentStatus status, size_t top_count) = 0;
+};
+
+// A SearchServer owned by a thread of its own. The index is built and read
+// only on that thread, so its memory is allocated there and stays local to
+// the core, or NUMA node, the thread runs on.
+class LocalSearchShard : public SearchShard {
+public:
+    explicit LocalSearchShard(const std::string_view stop_words_text);
+
+    LocalSearchShard(const LocalSearchShard&) = delete;
+    LocalSearchShard& operator=(const LocalSearchShard&) = delete;
+
+    // Finishes the calls already made
+    ~LocalSearchShard() override;
+
+    std::future<void> AddDocuments(std::vector<NewDocument> documents) override;
+
+    std::future<void> RemoveDocument(int document_id) override;
+
+    std::future<int> GetDocumentCount() override;
+
+    std::future<CorpusStatistics> CollectStatistics(const std::string_view raw_query) override;
+
+    std::future<std::vector<Document>> FindTopDocuments(const CorpusStatistics& statistics,
+        const std::string_view raw_query, DocumentStatus status, size_t top_count) override;
+
+private:
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::deque<std::function<void()>> tasks_;
+    bool stopping_ = false;
+    // Created and used on thread_ only
+    std::unique_ptr<SearchServer> search_server_;
+    std::thread thread_;
+
+    void Run();
+
+    // Lets the thread finish the queued calls and joins it
+    void Stop();
+
+    // Runs function(*search_server_) on the shard's thread
+    template <typename Function>
+    auto Post(Function function) -> std::future<decltype(function(*search_server_))>;
+};
+
+// Documents partitioned across shards by a hash of their id. A query is
+// scattered to every shard twice: first for the document counts of its
+// words, summed into collection-wide statistics, then for each shard's top
+// scored with them, so relevances equal those of a single SearchServer
+// holding every document. The shard tops are merged in the same order as
+// FindTopDocuments.
+class ShardedSearchServer {
+public:
+    // Local shards, each on a thread of its own
+    ShardedSearchServer(const std::string_view stop_words_text, size_t shard_count);
+
+    explicit ShardedSearchServer(std::vector<std::unique_ptr<SearchShard>> shards);
+
+    void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    // Every shard adds its part of the batch with AddDocuments, all at once.
+    // A shard that finds an invalid id or word adds nothing of its part; the
+    // other shards still add theirs.
+    void AddDocuments(const std::vector<NewDocument>& documents);
+
+    void RemoveDocument(int document_id);
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    int GetDocumentCount() const;
+
+    size_t GetShardCount() const;
+
+    size_t GetShardIndex(int document_id) const;
+
+private:
+    std::vector<std::unique_ptr<SearchShard>> shards_;
+};
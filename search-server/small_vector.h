@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+// Vector of trivially copyable values that keeps up to N of them inline and
+// moves them to the heap only once it grows past that.
+template <typename T, size_t N>
+class SmallVector {
+    static_assert(std::is_trivially_copyable_v<T>, "SmallVector holds trivially copyable values only");
+
+public:
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    T* data() {
+        return on_heap_ ? heap_.data() : inline_.data();
+    }
+
+    const T* data() const {
+        return on_heap_ ? heap_.data() : inline_.data();
+    }
+
+    T* begin() {
+        return data();
+    }
+
+    T* end() {
+        return data() + size_;
+    }
+
+    const T* begin() const {
+        return data();
+    }
+
+    const T* end() const {
+        return data() + size_;
+    }
+
+    T& operator[](size_t index) {
+        return data()[index];
+    }
+
+    const T& operator[](size_t index) const {
+        return data()[index];
+    }
+
+    void push_back(const T& value) {
+        if (!on_heap_ && size_ == N) {
+            MoveToHeap();
+        }
+        if (on_heap_) {
+            heap_.push_back(value);
+        }
+        else {
+            inline_[size_] = value;
+        }
+        ++size_;
+    }
+
+    void emplace_back(const T& value) {
+        push_back(value);
+    }
+
+    void resize(size_t size, const T& value = T()) {
+        if (!on_heap_ && size > N) {
+            MoveToHeap();
+        }
+        if (on_heap_) {
+            heap_.resize(size, value);
+        }
+        else if (size > size_) {
+            std::fill(inline_.begin() + size_, inline_.begin() + size, value);
+        }
+        size_ = size;
+    }
+
+    void assign(size_t size, const T& value) {
+        clear();
+        resize(size, value);
+    }
+
+    void clear() {
+        heap_.clear();
+        on_heap_ = false;
+        size_ = 0;
+    }
+
+private:
+    std::array<T, N> inline_;
+    std::vector<T> heap_;
+    size_t size_ = 0;
+    bool on_heap_ = false;
+
+    void MoveToHeap() {
+        heap_.assign(inline_.begin(), inline_.begin() + size_);
+        on_heap_ = true;
+    }
+};
@@ -0,0 +1,158 @@
+#include "sorted_id_kernels.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SEARCH_SERVER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+#if defined(__AVX2__)
+constexpr size_t BLOCK_SIZE = 8;
+#else
+constexpr size_t BLOCK_SIZE = 4;
+#endif
+
+// Below this length ratio the block kernel beats one search per id
+constexpr size_t GALLOP_RATIO = 32;
+
+// Bit i is set if a[i] equals any id of b; both point to BLOCK_SIZE ids
+uint32_t MatchBlock(const int* a, const int* b) {
+#if defined(__AVX2__)
+    const __m256i block_a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+    __m256i block_b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+    const __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+    __m256i equal = _mm256_cmpeq_epi32(block_a, block_b);
+    for (size_t i = 1; i < BLOCK_SIZE; ++i) {
+        block_b = _mm256_permutevar8x32_epi32(block_b, rotate);
+        equal = _mm256_or_si256(equal, _mm256_cmpeq_epi32(block_a, block_b));
+    }
+    return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(equal)));
+#elif defined(SEARCH_SERVER_SSE2)
+    const __m128i block_a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+    const __m128i block_b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+    __m128i equal = _mm_cmpeq_epi32(block_a, block_b);
+    equal = _mm_or_si128(equal, _mm_cmpeq_epi32(block_a, _mm_shuffle_epi32(block_b, _MM_SHUFFLE(0, 3, 2, 1))));
+    equal = _mm_or_si128(equal, _mm_cmpeq_epi32(block_a, _mm_shuffle_epi32(block_b, _MM_SHUFFLE(1, 0, 3, 2))));
+    equal = _mm_or_si128(equal, _mm_cmpeq_epi32(block_a, _mm_shuffle_epi32(block_b, _MM_SHUFFLE(2, 1, 0, 3))));
+    return static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(equal)));
+#else
+    uint32_t matches = 0;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        for (size_t j = 0; j < BLOCK_SIZE; ++j) {
+            matches |= static_cast<uint32_t>(a[i] == b[j]) << i;
+        }
+    }
+    return matches;
+#endif
+}
+
+// Walks both arrays a block at a time and keeps the ids of a that are
+// (keep_matches) or aren't in b. A block of a is written out once the
+// last block of b that can hold its ids has been compared with it.
+size_t MergeBlocks(const int* a, size_t a_size, const int* b, size_t b_size, int* out, bool keep_matches) {
+    size_t i = 0;
+    size_t j = 0;
+    size_t count = 0;
+    // Matches of the current block of a against the blocks of b so far
+    uint32_t matches = 0;
+    while (i + BLOCK_SIZE <= a_size && j + BLOCK_SIZE <= b_size) {
+        matches |= MatchBlock(a + i, b + j);
+        const int a_last = a[i + BLOCK_SIZE - 1];
+        const int b_last = b[j + BLOCK_SIZE - 1];
+        if (a_last <= b_last) {
+            for (size_t k = 0; k < BLOCK_SIZE; ++k) {
+                if (((matches >> k) & 1) == static_cast<uint32_t>(keep_matches)) {
+                    out[count++] = a[i + k];
+                }
+            }
+            i += BLOCK_SIZE;
+            matches = 0;
+        }
+        if (b_last <= a_last) {
+            j += BLOCK_SIZE;
+        }
+    }
+    // The rest of b is too short for a block; the current block of a may
+    // already have matched earlier blocks of b
+    for (size_t k = i; k < a_size; ++k) {
+        while (j < b_size && b[j] < a[k]) {
+            ++j;
+        }
+        const bool matched = (k < i + BLOCK_SIZE && ((matches >> (k - i)) & 1))
+            || (j < b_size && b[j] == a[k]);
+        if (matched == keep_matches) {
+            out[count++] = a[k];
+        }
+    }
+    return count;
+}
+
+// Looks each id of a up in the much longer b, doubling the step from the
+// previous position until it passes the id
+size_t Gallop(const int* a, size_t a_size, const int* b, size_t b_size, int* out, bool keep_matches) {
+    size_t count = 0;
+    size_t j = 0;
+    for (size_t i = 0; i < a_size; ++i) {
+        const int id = a[i];
+        size_t step = 1;
+        while (j + step < b_size && b[j + step] < id) {
+            j += step;
+            step *= 2;
+        }
+        j = static_cast<size_t>(std::lower_bound(b + j, b + std::min(j + step + 1, b_size), id) - b);
+        const bool matched = j < b_size && b[j] == id;
+        if (matched == keep_matches) {
+            out[count++] = id;
+        }
+    }
+    return count;
+}
+
+size_t Merge(const int* a, size_t a_size, const int* b, size_t b_size, int* out, bool keep_matches) {
+    size_t count = 0;
+    size_t j = 0;
+    for (size_t i = 0; i < a_size; ++i) {
+        while (j < b_size && b[j] < a[i]) {
+            ++j;
+        }
+        const bool matched = j < b_size && b[j] == a[i];
+        if (matched == keep_matches) {
+            out[count++] = a[i];
+        }
+    }
+    return count;
+}
+
+}
+
+size_t IntersectSortedIds(const int* a, size_t a_size, const int* b, size_t b_size, int* out) {
+    if (b_size >= GALLOP_RATIO * a_size) {
+        return Gallop(a, a_size, b, b_size, out, true);
+    }
+    if (a_size >= GALLOP_RATIO * b_size) {
+        // Common ids come out the same whichever side is looked up
+        return Gallop(b, b_size, a, a_size, out, true);
+    }
+    return MergeBlocks(a, a_size, b, b_size, out, true);
+}
+
+size_t SubtractSortedIds(const int* a, size_t a_size, const int* b, size_t b_size, int* out) {
+    if (b_size >= GALLOP_RATIO * a_size) {
+        return Gallop(a, a_size, b, b_size, out, false);
+    }
+    return MergeBlocks(a, a_size, b, b_size, out, false);
+}
+
+size_t IntersectSortedIdsScalar(const int* a, size_t a_size, const int* b, size_t b_size, int* out) {
+    return Merge(a, a_size, b, b_size, out, true);
+}
+
+size_t SubtractSortedIdsScalar(const int* a, size_t a_size, const int* b, size_t b_size, int* out) {
+    return Merge(a, a_size, b, b_size, out, false);
+}
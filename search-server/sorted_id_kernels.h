@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+
+// Set operations on ascending arrays of distinct ids. Arrays of similar
+// length are compared a block at a time with SIMD (AVX2 when enabled,
+// otherwise SSE2, otherwise scalar); when one is much longer, each id of
+// the short one is looked up in it by galloping search. Both write their
+// result, ascending, to out, which must have room for a_size ids and may
+// be a itself.
+
+// Ids present in both a and b; returns how many were written
+size_t IntersectSortedIds(const int* a, size_t a_size, const int* b, size_t b_size, int* out);
+
+// Ids of a not present in b; returns how many were written
+size_t SubtractSortedIds(const int* a, size_t a_size, const int* b, size_t b_size, int* out);
+
+// Both with a plain merge, for comparison
+size_t IntersectSortedIdsScalar(const int* a, size_t a_size, const int* b, size_t b_size, int* out);
+
+size_t SubtractSortedIdsScalar(const int* a, size_t a_size, const int* b, size_t b_size, int* out);
@@ -1,20 +1,116 @@
 #include"string_processing.h"
 
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SEARCH_SERVER_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 using namespace std;
 
+namespace {
+
+#if defined(__AVX2__)
+constexpr size_t BLOCK_SIZE = 32;
+#else
+constexpr size_t BLOCK_SIZE = 16;
+#endif
+constexpr uint32_t BLOCK_MASK = static_cast<uint32_t>((uint64_t{ 1 } << BLOCK_SIZE) - 1);
+
+// One bit per byte of a block
+struct BlockMasks {
+    uint32_t spaces;
+    uint32_t controls;
+};
+
+BlockMasks ClassifyBlock(const char* bytes) {
+#if defined(__AVX2__)
+    const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes));
+    const __m256i spaces = _mm256_cmpeq_epi8(block, _mm256_set1_epi8(' '));
+    // Signed comparisons, so bytes from 128 up aren't control characters
+    const __m256i controls = _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(' '), block),
+        _mm256_cmpgt_epi8(block, _mm256_set1_epi8(-1)));
+    return { static_cast<uint32_t>(_mm256_movemask_epi8(spaces)), static_cast<uint32_t>(_mm256_movemask_epi8(controls)) };
+#elif defined(SEARCH_SERVER_SSE2)
+    const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+    const __m128i spaces = _mm_cmpeq_epi8(block, _mm_set1_epi8(' '));
+    // Signed comparisons, so bytes from 128 up aren't control characters
+    const __m128i controls = _mm_and_si128(_mm_cmplt_epi8(block, _mm_set1_epi8(' ')),
+        _mm_cmpgt_epi8(block, _mm_set1_epi8(-1)));
+    return { static_cast<uint32_t>(_mm_movemask_epi8(spaces)), static_cast<uint32_t>(_mm_movemask_epi8(controls)) };
+#else
+    BlockMasks masks{ 0, 0 };
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        const char c = bytes[i];
+        masks.spaces |= static_cast<uint32_t>(c == ' ') << i;
+        masks.controls |= static_cast<uint32_t>(c >= '\0' && c < ' ') << i;
+    }
+    return masks;
+#endif
+}
+
+size_t CountTrailingZeros(uint32_t bits) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return index;
+#else
+    return static_cast<size_t>(__builtin_ctz(bits));
+#endif
+}
+
+}
+
 vector<string_view> SplitIntoWords(string_view text)
 {
-
     vector<string_view> words;
-    string word;
-    auto pos = text.find(' ');
-    size_t first = 0;
-    while (pos != text.npos)
-    {
-        words.push_back(text.substr(first, pos - first));
-        first = pos + 1;
-        pos = text.find(' ', first);
-    }
-    words.push_back(text.substr(first, pos - first));
+    SplitIntoWords(text, words);
     return words;
-}
\ No newline at end of file
+}
+
+size_t SplitIntoWords(string_view text, vector<string_view>& words)
+{
+    words.clear();
+    size_t first_control = text.npos;
+    size_t word_start = text.npos;
+    // Text starts as if after a space
+    uint32_t previous_space = 1;
+    char padded[BLOCK_SIZE];
+    for (size_t offset = 0; offset < text.size(); offset += BLOCK_SIZE) {
+        const char* block = text.data() + offset;
+        if (text.size() - offset < BLOCK_SIZE) {
+            // Spaces after the end close the last word
+            fill(begin(padded), end(padded), ' ');
+            copy(block, text.data() + text.size(), padded);
+            block = padded;
+        }
+        const BlockMasks masks = ClassifyBlock(block);
+        if (masks.controls != 0 && first_control == text.npos) {
+            first_control = offset + CountTrailingZeros(masks.controls);
+        }
+        // Bits where a word starts or ends
+        uint32_t edges = (masks.spaces ^ (masks.spaces << 1 | previous_space)) & BLOCK_MASK;
+        previous_space = masks.spaces >> (BLOCK_SIZE - 1) & 1;
+        for (; edges != 0; edges &= edges - 1) {
+            const size_t position = offset + CountTrailingZeros(edges);
+            if (word_start == text.npos) {
+                word_start = position;
+            }
+            else {
+                words.push_back(text.substr(word_start, position - word_start));
+                word_start = text.npos;
+            }
+        }
+    }
+    if (word_start != text.npos) {
+        words.push_back(text.substr(word_start));
+    }
+    return first_control;
+}
@@ -1,11 +1,39 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
 #include <set>
 #include <vector>
 #include <string>
+#include <string_view>
 
+// Splits text at spaces. Runs of spaces and spaces at either end don't
+// produce empty words.
 std::vector<std::string_view> SplitIntoWords(const std::string_view text);
 
+// Same as above, but fills words, whose storage is reused across calls, and
+// checks for control characters (bytes 0-31) in the same pass. Returns the
+// position of the first one in text, or npos if there is none.
+size_t SplitIntoWords(const std::string_view text, std::vector<std::string_view>& words);
+
+// Calls function for each word of text, split as above, without storing
+// them. Stops early once function returns false.
+template <typename Function>
+void ForEachWord(std::string_view text, Function function) {
+    while (true) {
+        const size_t word_start = text.find_first_not_of(' ');
+        if (word_start == text.npos) {
+            return;
+        }
+        text.remove_prefix(word_start);
+        const size_t word_end = std::min(text.find(' '), text.size());
+        if (!function(text.substr(0, word_end))) {
+            return;
+        }
+        text.remove_prefix(word_end);
+    }
+}
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string,std::less<>> non_empty_strings;
@@ -15,4 +43,4 @@ std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContain
         }
     }
     return non_empty_strings;
-}
\ No newline at end of file
+}
@@ -0,0 +1,165 @@
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+using std::string_literals::operator""s;
+
+TermDictionary::TermDictionary(const TermDictionary& other)
+    : mapped_offsets_(other.mapped_offsets_)
+    , mapped_text_(other.mapped_text_)
+    , mapped_count_(other.mapped_count_)
+    , mapped_buckets_(other.mapped_buckets_)
+    , mapped_bucket_count_(other.mapped_bucket_count_) {
+    // Views of the other dictionary point into its own arena, so re-intern
+    id_to_term_.reserve(other.id_to_term_.size());
+    term_to_id_.reserve(other.id_to_term_.size());
+    for (const std::string_view term : other.id_to_term_) {
+        Intern(term);
+    }
+}
+
+TermDictionary& TermDictionary::operator=(const TermDictionary& other) {
+    if (this != &other) {
+        TermDictionary copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+TermId TermDictionary::Intern(const std::string_view term) {
+    if (mapped_offsets_) {
+        if (const auto term_id = Find(term)) {
+            return *term_id;
+        }
+        Detach();
+    }
+    if (const auto it = term_to_id_.find(term); it != term_to_id_.end()) {
+        return it->second;
+    }
+    const std::string_view stored = storage_.Append(term);
+    const TermId term_id = static_cast<TermId>(id_to_term_.size());
+    id_to_term_.push_back(stored);
+    term_to_id_.emplace(stored, term_id);
+    return term_id;
+}
+
+TermId TermDictionary::InternExternal(const std::string_view term) {
+    if (const auto it = term_to_id_.find(term); it != term_to_id_.end()) {
+        return it->second;
+    }
+    const TermId term_id = static_cast<TermId>(id_to_term_.size());
+    id_to_term_.push_back(term);
+    term_to_id_.emplace(term, term_id);
+    return term_id;
+}
+
+std::optional<TermId> TermDictionary::Find(const std::string_view term) const {
+    if (mapped_offsets_) {
+        for (size_t bucket = Hash(term) & (mapped_bucket_count_ - 1);; bucket = (bucket + 1) & (mapped_bucket_count_ - 1)) {
+            const TermId term_id = mapped_buckets_[bucket];
+            if (term_id >= mapped_count_) {
+                return std::nullopt;
+            }
+            if (GetTerm(term_id) == term) {
+                return term_id;
+            }
+        }
+    }
+    if (const auto it = term_to_id_.find(term); it != term_to_id_.end()) {
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+std::string_view TermDictionary::GetTerm(TermId term_id) const {
+    if (mapped_offsets_) {
+        return std::string_view(mapped_text_ + mapped_offsets_[term_id], mapped_offsets_[term_id + 1] - mapped_offsets_[term_id]);
+    }
+    return id_to_term_[term_id];
+}
+
+size_t TermDictionary::size() const {
+    return mapped_offsets_ ? mapped_count_ : id_to_term_.size();
+}
+
+size_t TermDictionary::GetTextBytes() const {
+    return storage_.GetAllocatedBytes();
+}
+
+void TermDictionary::Serialize(IndexFileWriter& writer) const {
+    writer.WriteValue<uint64_t>(size());
+    uint64_t text_offset = 0;
+    for (TermId term_id = 0; term_id < size(); ++term_id) {
+        writer.WriteValue(text_offset);
+        text_offset += GetTerm(term_id).size();
+    }
+    writer.WriteValue(text_offset);
+    for (TermId term_id = 0; term_id < size(); ++term_id) {
+        writer.Write(GetTerm(term_id).data(), GetTerm(term_id).size());
+    }
+    writer.Align();
+
+    // At most half full, so that misses stop after a few probes
+    size_t bucket_count = 1;
+    while (bucket_count < 2 * size()) {
+        bucket_count *= 2;
+    }
+    std::vector<TermId> buckets(bucket_count, NO_TERM);
+    for (TermId term_id = 0; term_id < size(); ++term_id) {
+        size_t bucket = Hash(GetTerm(term_id)) & (bucket_count - 1);
+        while (buckets[bucket] != NO_TERM) {
+            bucket = (bucket + 1) & (bucket_count - 1);
+        }
+        buckets[bucket] = term_id;
+    }
+    writer.WriteValue<uint64_t>(bucket_count);
+    writer.Write(buckets.data(), bucket_count * sizeof(TermId));
+}
+
+TermDictionary TermDictionary::Map(const uint8_t* bytes, size_t size) {
+    IndexSectionReader reader({ bytes, size });
+    TermDictionary dictionary;
+    dictionary.mapped_count_ = reader.ReadValue<uint64_t>();
+    if (dictionary.mapped_count_ >= size / sizeof(uint64_t)) {
+        throw std::runtime_error("Index file words are corrupted"s);
+    }
+    dictionary.mapped_offsets_ = reinterpret_cast<const uint64_t*>(reader.Skip((dictionary.mapped_count_ + 1) * sizeof(uint64_t)));
+    const uint64_t* offsets_end = dictionary.mapped_offsets_ + dictionary.mapped_count_ + 1;
+    if (!std::is_sorted(dictionary.mapped_offsets_, offsets_end) || dictionary.mapped_offsets_[0] != 0) {
+        throw std::runtime_error("Index file words are corrupted"s);
+    }
+    dictionary.mapped_text_ = reinterpret_cast<const char*>(reader.Skip(offsets_end[-1]));
+    reader.Align();
+
+    dictionary.mapped_bucket_count_ = reader.ReadValue<uint64_t>();
+    // A power of two with at least one empty bucket, so every probe sequence ends
+    if (dictionary.mapped_bucket_count_ <= dictionary.mapped_count_ || dictionary.mapped_bucket_count_ >= size / sizeof(TermId)
+        || (dictionary.mapped_bucket_count_ & (dictionary.mapped_bucket_count_ - 1)) != 0) {
+        throw std::runtime_error("Index file words are corrupted"s);
+    }
+    dictionary.mapped_buckets_ = reinterpret_cast<const TermId*>(reader.Skip(dictionary.mapped_bucket_count_ * sizeof(TermId)));
+    return dictionary;
+}
+
+void TermDictionary::Detach() {
+    const uint64_t* offsets = mapped_offsets_;
+    const char* text = mapped_text_;
+    const size_t count = mapped_count_;
+    mapped_offsets_ = nullptr;
+    mapped_text_ = nullptr;
+    mapped_count_ = 0;
+    mapped_buckets_ = nullptr;
+    mapped_bucket_count_ = 0;
+    id_to_term_.reserve(count);
+    term_to_id_.reserve(count);
+    for (size_t term_id = 0; term_id < count; ++term_id) {
+        InternExternal(std::string_view(text + offsets[term_id], offsets[term_id + 1] - offsets[term_id]));
+    }
+}
+
+size_t TermDictionary::Hash(const std::string_view term) {
+    // Stable across runs, unlike std::hash
+    return static_cast<size_t>(ComputeChecksum(term.data(), term.size()));
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "index_file.h"
+#include "text_arena.h"
+
+using TermId = uint32_t;
+
+// Stores every distinct word once and assigns it a dense id.
+// Lookups by string_view never allocate. A dictionary read from an index
+// file looks words up in the mapped file until a new word is interned.
+class TermDictionary {
+public:
+    TermDictionary() = default;
+
+    // Copies of a mapped dictionary share the file; other copies own their text
+    TermDictionary(const TermDictionary& other);
+    TermDictionary& operator=(const TermDictionary& other);
+
+    TermDictionary(TermDictionary&&) = default;
+    TermDictionary& operator=(TermDictionary&&) = default;
+
+    TermId Intern(const std::string_view term);
+
+    std::optional<TermId> Find(const std::string_view term) const;
+
+    std::string_view GetTerm(TermId term_id) const;
+
+    size_t size() const;
+
+    size_t GetTextBytes() const;
+
+    // Writes the words in id order and a hash table over them, in the
+    // layout Map reads
+    void Serialize(IndexFileWriter& writer) const;
+
+    // Reads a dictionary written by Serialize without copying it, so the
+    // bytes must outlive the dictionary and all of its copies
+    static TermDictionary Map(const uint8_t* bytes, size_t size);
+
+private:
+    static constexpr TermId NO_TERM = UINT32_MAX;
+
+    TextArena storage_;
+    std::vector<std::string_view> id_to_term_;
+    std::unordered_map<std::string_view, TermId> term_to_id_;
+    // Used instead of the containers above while the words are in a mapped file
+    const uint64_t* mapped_offsets_ = nullptr;
+    const char* mapped_text_ = nullptr;
+    size_t mapped_count_ = 0;
+    // Open addressing with linear probing; the count is a power of two
+    const TermId* mapped_buckets_ = nullptr;
+    size_t mapped_bucket_count_ = 0;
+
+    // Like Intern, but keeps a view of the given text instead of copying it
+    TermId InternExternal(const std::string_view term);
+
+    // Moves the words of a mapped file into the containers, as views of the file
+    void Detach();
+
+    static size_t Hash(const std::string_view term);
+};
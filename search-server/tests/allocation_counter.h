@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+
+// The test binary replaces the global operator new so that tests can count
+// allocations; the search server itself is built without it. Returns the
+// number made by the calling thread so far.
+size_t GetThreadAllocationCount();
@@ -0,0 +1,9 @@
+// The test binary: these files and every file of the parent directory but
+// main.cpp, built with the parent directory on the include path, e.g.
+//   g++ -std=c++17 -O1 -pthread -I. tests/*.cpp $(ls *.cpp | grep -v main.cpp) -ltbb
+#include "test_search_server.h"
+
+int main() {
+    TestSearchServer();
+    return 0;
+}
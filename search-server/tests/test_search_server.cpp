@@ -0,0 +1,937 @@
+#include "test_search_server.h"
+
+#include "allocation_counter.h"
+#include "concurrent_map.h"
+#include "concurrent_search_server.h"
+#include "corpus_loader.h"
+#include "near_duplicates.h"
+#include "index_file.h"
+#include "posting_list.h"
+#include "process_queries.h"
+#include "query_cache.h"
+#include "remove_duplicates.h"
+#include "search_server.h"
+#include "segmented_search_server.h"
+#include "sharded_search_server.h"
+#include "string_processing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+void AssertImpl(bool value, const string& expr_str, const string& file, const string& func, unsigned line,
+    const string& hint) {
+    if (!value) {
+        cerr << file << "("s << line << "): "s << func << ": "s;
+        cerr << "ASSERT("s << expr_str << ") failed."s;
+        if (!hint.empty()) {
+            cerr << " Hint: "s << hint;
+        }
+        cerr << endl;
+        abort();
+    }
+}
+
+namespace {
+
+// Documents of a small corpus where every word appears in several of them
+vector<string> MakeTexts(int document_count) {
+    static const string WORDS[] = { "cat"s, "dog"s, "bird"s, "fish"s, "white"s, "black"s, "big"s, "small"s,
+        "tail"s, "eyes"s, "collar"s, "nasty"s, "curly"s, "fancy"s, "grey"s };
+    vector<string> texts;
+    for (int id = 0; id < document_count; ++id) {
+        string text;
+        for (int i = 0; i < 3 + id % 5; ++i) {
+            text += WORDS[(id * 7 + i * i * 3) % size(WORDS)] + " "s;
+        }
+        texts.push_back(move(text));
+    }
+    return texts;
+}
+
+const vector<string> QUERIES = { "cat"s, "white dog"s, "curly tail -cat"s, "fancy grey bird fish"s, "big -small eyes"s };
+
+bool SameDocuments(const vector<Document>& lhs, const vector<Document>& rhs, double tolerance = 0.0) {
+    return lhs.size() == rhs.size() && equal(lhs.begin(), lhs.end(), rhs.begin(), [tolerance](const Document& l, const Document& r) {
+        return l.id == r.id && l.rating == r.rating && abs(l.relevance - r.relevance) <= tolerance;
+    });
+}
+
+vector<int> CollectPostings(const PostingList& list) {
+    vector<int> document_ids;
+    list.ForEach([&document_ids](int document_id, uint32_t) {
+        document_ids.push_back(document_id);
+    });
+    return document_ids;
+}
+
+}
+
+void TestExcludeStopWordsFromAddedDocumentContent() {
+    {
+        SearchServer server(""s);
+        server.AddDocument(42, "cat in the city"s, DocumentStatus::ACTUAL, { 1, 2, 3 });
+        const auto found_docs = server.FindTopDocuments("in"s);
+        ASSERT_EQUAL(found_docs.size(), 1u);
+        ASSERT_EQUAL(found_docs[0].id, 42);
+        ASSERT_EQUAL(found_docs[0].rating, 2);
+    }
+    {
+        SearchServer server("in the"s);
+        server.AddDocument(42, "cat in the city"s, DocumentStatus::ACTUAL, { 1, 2, 3 });
+        ASSERT_HINT(server.FindTopDocuments("in"s).empty(), "Stop words must be excluded from documents"s);
+    }
+}
+
+void TestMinusWordsAndStatuses() {
+    SearchServer server("and with"s);
+    server.AddDocument(1, "white cat and yellow hat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "curly cat curly tail"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "nasty dog with big eyes"s, DocumentStatus::BANNED, { 3 });
+    const auto found_docs = server.FindTopDocuments("curly nasty cat -hat"s);
+    ASSERT_EQUAL(found_docs.size(), 1u);
+    ASSERT_EQUAL(found_docs[0].id, 2);
+    const auto banned = server.FindTopDocuments("curly nasty cat"s, DocumentStatus::BANNED);
+    ASSERT_EQUAL(banned.size(), 1u);
+    ASSERT_EQUAL(banned[0].id, 3);
+    const auto [words, status] = server.MatchDocument("curly tail -dog"s, 2);
+    ASSERT_EQUAL(words.size(), 2u);
+    ASSERT(status == DocumentStatus::ACTUAL);
+    ASSERT(get<0>(server.MatchDocument("curly -cat"s, 2)).empty());
+}
+
+void TestWordFrequencies() {
+    SearchServer server("and"s);
+    server.AddDocument(1, "curly cat and curly tail"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "nasty dog"s, DocumentStatus::BANNED, { 2 });
+    const map<string_view, double> expected = { { "cat"sv, 0.25 }, { "curly"sv, 0.5 }, { "tail"sv, 0.25 } };
+    ASSERT(server.GetWordFrequencies(1) == expected);
+
+    server.RemoveDocument(2);
+    for (const int document_id : { 2, 3 }) {
+        try {
+            server.GetWordFrequencies(document_id);
+            ASSERT_HINT(false, "an unknown document had word frequencies"s);
+        } catch (const out_of_range&) {
+        }
+    }
+}
+
+void TestTopCountAndTieBreak() {
+    SearchServer server(""s);
+    // Same text, so equal relevance: rating decides, then the smaller id,
+    // whatever the order of insertion
+    for (const auto& [id, rating] : vector<pair<int, int>>{ { 4, 7 }, { 3, 5 }, { 6, 9 }, { 1, 5 }, { 2, 7 }, { 5, 1 } }) {
+        server.AddDocument(id, "cat dog"s, DocumentStatus::ACTUAL, { rating });
+    }
+    server.AddDocument(10, "cat"s, DocumentStatus::ACTUAL, { 0 });
+    server.AddDocument(20, "bird"s, DocumentStatus::ACTUAL, { 0 });
+    const vector<int> expected_ids = { 10, 6, 2, 4, 1, 3, 5 };
+
+    for (const size_t top_count : { size_t{ 0 }, size_t{ 1 }, size_t{ 3 }, size_t{ 5 }, size_t{ 6 }, size_t{ 100 } }) {
+        const vector<int> expected(expected_ids.begin(), expected_ids.begin() + min(top_count, expected_ids.size()));
+        const auto ids = [](const vector<Document>& documents) {
+            vector<int> result;
+            for (const Document& document : documents) {
+                result.push_back(document.id);
+            }
+            return result;
+        };
+        ASSERT(ids(server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, top_count)) == expected);
+        ASSERT(ids(server.FindTopDocuments(execution::par, "cat"s, DocumentStatus::ACTUAL, top_count)) == expected);
+        vector<Document> result;
+        ASSERT(server.TryFindTopDocuments("cat"s, DocumentStatus::ACTUAL, result, top_count) == QueryError::NONE);
+        ASSERT(ids(result) == expected);
+        ASSERT(ids(server.FindTopDocumentsWithAllWords("cat"s, DocumentStatus::ACTUAL, top_count)) == expected);
+    }
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+}
+
+void TestShardedScoring() {
+    // Enough documents for the parallel policy to split scoring into several
+    // id ranges (SearchServer::MIN_SHARD_SIZE each), the last one partial
+    const int document_count = 3 * 16 * 1024 + 1000;
+    const auto texts = MakeTexts(document_count);
+    SearchServer server("and"s);
+    for (int id = 0; id < document_count; ++id) {
+        const DocumentStatus status = id % 4 == 3 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+        server.AddDocument(id, texts[id], status, { id % 11 });
+    }
+
+    // Whole result lists are compared, so that a document lost at a range
+    // boundary shows up even if it would never make the top five
+    const auto check = [&server, document_count]() {
+        const auto predicate = [](int document_id, DocumentStatus, int rating) {
+            return document_id % 3 == 0 && rating > 4;
+        };
+        for (const string& query : QUERIES) {
+            ASSERT(SameDocuments(server.FindTopDocuments(execution::par, query), server.FindTopDocuments(execution::seq, query)));
+            ASSERT(SameDocuments(server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, document_count),
+                server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, document_count)));
+            ASSERT(SameDocuments(server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED, document_count),
+                server.FindTopDocuments(execution::seq, query, DocumentStatus::BANNED, document_count)));
+            ASSERT(SameDocuments(server.FindTopDocuments(execution::par, query, predicate, document_count),
+                server.FindTopDocuments(execution::seq, query, predicate, document_count)));
+        }
+    };
+    check();
+
+    // Empty the whole first range and thin out the others
+    for (int id = 0; id < document_count; ++id) {
+        if (id < 16 * 1024 || id % 5 == 0) {
+            server.RemoveDocument(id);
+        }
+    }
+    check();
+    for (const string& query : QUERIES) {
+        for (const Document& document : server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, document_count)) {
+            ASSERT(document.id >= 16 * 1024 && document.id % 5 != 0);
+        }
+    }
+}
+
+void TestSplitIntoWords() {
+    // Word by word, byte by byte
+    const auto split_slowly = [](const string& text, size_t& first_control) {
+        vector<string> words;
+        first_control = string::npos;
+        string word;
+        for (size_t i = 0; i <= text.size(); ++i) {
+            if (i == text.size() || text[i] == ' ') {
+                if (!word.empty()) {
+                    words.push_back(word);
+                }
+                word.clear();
+                continue;
+            }
+            if (first_control == string::npos && text[i] >= '\0' && text[i] < ' ') {
+                first_control = i;
+            }
+            word += text[i];
+        }
+        return words;
+    };
+
+    // Lengths around the 16 and 32 byte blocks, with words, runs of spaces
+    // and control characters falling on every position of a block
+    static constexpr char ALPHABET[] = { 'a', 'b', ' ', ' ', '\x01', '\x1f', '\x7f', '\x80', '\xff' };
+    mt19937 generator(15);
+    vector<string_view> words;
+    for (size_t length = 0; length <= 100; ++length) {
+        for (int repeat = 0; repeat < 30; ++repeat) {
+            string text(length, ' ');
+            for (char& c : text) {
+                c = ALPHABET[uniform_int_distribution<size_t>(0, size(ALPHABET) - (repeat % 2 == 0 ? 1 : 5))(generator)];
+            }
+            size_t expected_control = 0;
+            const vector<string> expected = split_slowly(text, expected_control);
+            ASSERT_EQUAL(SplitIntoWords(text, words), expected_control);
+            ASSERT_HINT(vector<string>(words.begin(), words.end()) == expected, text);
+            vector<string> each_word;
+            ForEachWord(text, [&each_word](string_view word) {
+                each_word.emplace_back(word);
+                return true;
+            });
+            ASSERT_HINT(each_word == expected, text);
+        }
+    }
+
+    for (const size_t boundary : { size_t{ 15 }, size_t{ 16 }, size_t{ 31 }, size_t{ 32 }, size_t{ 33 } }) {
+        const string word(boundary, 'a');
+        string text = word + " b"s;
+        ASSERT_EQUAL(SplitIntoWords(text, words), string::npos);
+        ASSERT(words == vector<string_view>({ word, "b"sv }));
+        text[boundary - 1] = '\t';
+        ASSERT_EQUAL(SplitIntoWords(text, words), boundary - 1);
+        ASSERT_EQUAL(words.size(), 2u);
+        ASSERT_EQUAL(words[0].size(), boundary);
+    }
+}
+
+void TestPostingCursors() {
+    // Two compressed blocks and a tail
+    const int posting_count = static_cast<int>(2 * PostingList::BLOCK_SIZE + 20);
+    PostingList list;
+    for (int i = 0; i < posting_count; ++i) {
+        list.Add(i * 3, 1 + i % 4);
+    }
+    ASSERT_EQUAL(list.size(), static_cast<size_t>(posting_count));
+
+    PostingList::Cursor cursor(list);
+    for (int i = 0; i < posting_count; ++i, cursor.Next()) {
+        ASSERT(!cursor.AtEnd());
+        ASSERT_EQUAL(cursor.GetDocumentId(), i * 3);
+        ASSERT_EQUAL(cursor.GetTermCount(), static_cast<uint32_t>(1 + i % 4));
+    }
+    ASSERT(cursor.AtEnd());
+
+    PostingList::Cursor skipping(list);
+    skipping.SkipTo(1);
+    ASSERT_EQUAL(skipping.GetDocumentId(), 3);
+    // Into the second block without decoding the first one again
+    skipping.SkipTo(3 * 200 - 1);
+    ASSERT_EQUAL(skipping.GetDocumentId(), 3 * 200);
+    skipping.SkipTo(3 * 200);
+    ASSERT_EQUAL(skipping.GetDocumentId(), 3 * 200);
+    skipping.SkipTo(3 * (posting_count - 1));
+    ASSERT_EQUAL(skipping.GetDocumentId(), 3 * (posting_count - 1));
+    skipping.SkipTo(3 * posting_count);
+    ASSERT(skipping.AtEnd());
+
+    // Removed postings in blocks are tombstoned, in the tail dropped
+    list.Remove(0);
+    list.Remove(3 * 130);
+    list.Remove(3 * (posting_count - 1));
+    ASSERT(!list.Contains(3 * 130));
+    ASSERT(list.Contains(3 * 131));
+    ASSERT_EQUAL(list.size(), static_cast<size_t>(posting_count - 3));
+    PostingList::Cursor after_removal(list);
+    ASSERT_EQUAL(after_removal.GetDocumentId(), 3);
+    after_removal.SkipTo(3 * 130);
+    ASSERT_EQUAL(after_removal.GetDocumentId(), 3 * 131);
+    const auto document_ids = CollectPostings(list);
+    ASSERT_EQUAL(document_ids.size(), list.size());
+    ASSERT(is_sorted(document_ids.begin(), document_ids.end()));
+
+    // Compacting drops the tombstones without changing the postings
+    list.Compact();
+    ASSERT(CollectPostings(list) == document_ids);
+}
+
+void TestCorruptedPostings() {
+    PostingList list;
+    for (int i = 0; i < static_cast<int>(2 * PostingList::BLOCK_SIZE); ++i) {
+        list.Add(i * 1000, 1);
+    }
+    const string path = (filesystem::temp_directory_path() / "search_server_test_postings.bin"s).string();
+    {
+        IndexFileWriter writer(path);
+        writer.BeginSection(IndexSection::POSTINGS);
+        list.Serialize(writer);
+        writer.EndSection();
+        writer.Finish();
+    }
+    const IndexFile file(path);
+    const IndexFile::Bytes bytes = file.GetSection(IndexSection::POSTINGS);
+    ASSERT(CollectPostings(PostingList::Map(bytes.data, bytes.size)) == CollectPostings(list));
+
+    // Varints that never end and a block offset past the data must not be
+    // read beyond the section
+    // Four sizes, then the last document id and data offset of each block
+    const size_t blocks_begin = 4 * sizeof(uint32_t);
+    const size_t data_begin = blocks_begin + 2 * 2 * sizeof(uint32_t);
+    vector<uint8_t> corrupted(bytes.data, bytes.data + bytes.size);
+    fill(corrupted.begin() + data_begin, corrupted.end(), 0xFF);
+    const PostingList endless = PostingList::Map(corrupted.data(), corrupted.size());
+    bool thrown = false;
+    try {
+        PostingList::Cursor cursor(endless);
+    }
+    catch (const runtime_error&) {
+        thrown = true;
+    }
+    ASSERT_HINT(thrown, "Reading a corrupted block must throw"s);
+
+    corrupted.assign(bytes.data, bytes.data + bytes.size);
+    const uint32_t offset = 1 << 30;
+    memcpy(corrupted.data() + blocks_begin + 3 * sizeof(uint32_t), &offset, sizeof(offset));
+    const PostingList misplaced = PostingList::Map(corrupted.data(), corrupted.size());
+    thrown = false;
+    try {
+        misplaced.Contains(1000 * 200);
+    }
+    catch (const runtime_error&) {
+        thrown = true;
+    }
+    ASSERT_HINT(thrown, "A block outside the data must throw"s);
+    filesystem::remove(path);
+}
+
+void TestAddDocuments() {
+    const auto texts = MakeTexts(3000);
+    vector<NewDocument> documents;
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        documents.push_back({ id, texts[id], static_cast<DocumentStatus>(id % 3), { id % 10, 1 } });
+    }
+    SearchServer expected("and in"s);
+    for (const NewDocument& document : documents) {
+        expected.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+
+    const auto check_batch = [&](auto policy) {
+        SearchServer server("and in"s);
+        server.AddDocument(5000, "cat eyes"s, DocumentStatus::ACTUAL, { 1 });
+        const uint64_t generation = server.GetGeneration();
+        // Every bad batch is rejected as a whole, whatever is wrong in it
+        vector<vector<NewDocument>> bad_batches(4, documents);
+        bad_batches[0][2000].id = 7;
+        bad_batches[1][2500].id = -1;
+        bad_batches[2][1500].id = 5000;
+        bad_batches[3][2999].text = "cat do\x12g"sv;
+        for (const vector<NewDocument>& batch : bad_batches) {
+            try {
+                server.AddDocuments(policy, batch);
+                ASSERT_HINT(false, "a bad batch was accepted"s);
+            } catch (const invalid_argument&) {
+            }
+            ASSERT_EQUAL(server.GetDocumentCount(), 1);
+            ASSERT_EQUAL(server.GetGeneration(), generation);
+            ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), 1u);
+        }
+
+        server.RemoveDocument(5000);
+        server.AddDocuments(policy, documents);
+        ASSERT_EQUAL(server.GetDocumentCount(), expected.GetDocumentCount());
+        for (const string& query : QUERIES) {
+            for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+                ASSERT_HINT(SameDocuments(server.FindTopDocuments(query, status), expected.FindTopDocuments(query, status)),
+                    query);
+            }
+        }
+        ASSERT(server.GetWordFrequencies(2999) == expected.GetWordFrequencies(2999));
+    };
+    check_batch(execution::seq);
+    check_batch(execution::par);
+}
+
+void TestFindTopDocumentsWithAllWords() {
+    const auto texts = MakeTexts(400);
+    SearchServer server("and in"s);
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 2), { id % 10 });
+    }
+    for (int id = 0; id < static_cast<int>(texts.size()); id += 9) {
+        server.RemoveDocument(id);
+    }
+
+    size_t found_count = 0;
+    for (const string& query : { "cat curly"s, "cat fish -curly"s, "big fish eyes"s, "grey nasty grey"s, "small and white"s,
+        "dog fancy -white"s, "curly -curly"s, "nosuchword cat"s, "tail"s }) {
+        // Documents containing every plus word and no minus word, found from the texts
+        vector<string_view> plus_words;
+        vector<string_view> minus_words;
+        for (const string_view word : SplitIntoWords(query)) {
+            if (word[0] == '-') {
+                minus_words.push_back(word.substr(1));
+            }
+            else if (word != "and"sv) {
+                plus_words.push_back(word);
+            }
+        }
+        const auto has_all_words = [&](int document_id) {
+            const vector<string_view> words = SplitIntoWords(texts[document_id]);
+            const auto contains = [&words](string_view word) {
+                return find(words.begin(), words.end(), word) != words.end();
+            };
+            return all_of(plus_words.begin(), plus_words.end(), contains) && none_of(minus_words.begin(), minus_words.end(), contains);
+        };
+        for (const size_t top_count : { size_t{ 1 }, size_t{ 5 }, size_t{ 1000 } }) {
+            const auto predicate = [&](int document_id, DocumentStatus status, int) {
+                return status == DocumentStatus::ACTUAL && has_all_words(document_id);
+            };
+            const vector<Document> expected = server.FindTopDocuments(query, predicate, top_count);
+            found_count += expected.size();
+            ASSERT_HINT(SameDocuments(server.FindTopDocumentsWithAllWords(query, DocumentStatus::ACTUAL, top_count), expected), query);
+            ASSERT_HINT(SameDocuments(server.FindTopDocumentsWithAllWords(query, [](int document_id, DocumentStatus, int) {
+                return document_id % 2 == 0;
+            }, top_count), expected), query);
+        }
+    }
+    ASSERT(found_count > 100);
+}
+
+void TestConcurrentMap() {
+    // Strided keys, which used to pile into the same slots
+    constexpr int KEY_COUNT = 5000;
+    constexpr int STRIDE = 1024;
+    ConcurrentMap<int, int> map(7);
+    vector<thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&map, t] {
+            for (int i = 0; i < KEY_COUNT; ++i) {
+                map.FetchAdd(i * STRIDE, t + 1);
+            }
+        });
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+    ASSERT_EQUAL(map.size(), static_cast<size_t>(KEY_COUNT));
+    ASSERT_EQUAL(map.FetchAdd(STRIDE, 5), 10);
+    map[2 * STRIDE].ref_to_value = -1;
+    ASSERT_EQUAL(map[-3].ref_to_value, 0);
+
+    vector<pair<int, int>> entries = map.MoveOut();
+    ASSERT_EQUAL(map.size(), 0u);
+    sort(entries.begin(), entries.end());
+    ASSERT_EQUAL(entries.size(), static_cast<size_t>(KEY_COUNT + 1));
+    ASSERT(entries[0] == make_pair(-3, 0));
+    for (int i = 0; i < KEY_COUNT; ++i) {
+        const int expected = i == 1 ? 15 : i == 2 ? -1 : 10;
+        ASSERT_EQUAL(entries[i + 1].first, i * STRIDE);
+        ASSERT_EQUAL(entries[i + 1].second, expected);
+    }
+}
+
+void TestLoadCorpus() {
+    const auto texts = MakeTexts(200);
+    string corpus;
+    const string STATUS_NAMES[] = { "ACTUAL"s, "IRRELEVANT"s, "BANNED"s, "REMOVED"s };
+    SearchServer expected(""s);
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        const DocumentStatus status = static_cast<DocumentStatus>(id % 4);
+        // One line far longer than a block, some with CRLF, blank lines
+        // and extra spaces between ratings
+        const string text = id == 50 ? texts[id] + string(100, 'x') : texts[id];
+        corpus += to_string(id) + "\t"s + STATUS_NAMES[id % 4] + "\t"s + to_string(id % 10) + "  -3\t"s + text
+            + (id % 3 == 0 ? "\r\n"s : "\n"s) + (id % 7 == 0 ? "\n"s : ""s);
+        expected.AddDocument(id, text, status, { id % 10, -3 });
+    }
+    // No newline after the last line
+    corpus += "1000\tACTUAL\t\tlast cat"s;
+    expected.AddDocument(1000, "last cat"s, DocumentStatus::ACTUAL, {});
+
+    for (const size_t block_size : { size_t{ 16 }, size_t{ 100 }, size_t{ 1 } << 20 }) {
+        SearchServer server(""s);
+        istringstream input(corpus);
+        const CorpusLoadStatistics statistics = LoadCorpus(server, input, { block_size, 1 });
+        ASSERT_EQUAL(statistics.document_count, texts.size() + 1);
+        ASSERT_EQUAL(statistics.byte_count, corpus.size());
+        ASSERT(vector<int>(server.begin(), server.end()) == vector<int>(expected.begin(), expected.end()));
+        for (const string& query : QUERIES) {
+            for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::REMOVED }) {
+                ASSERT_HINT(SameDocuments(server.FindTopDocuments(query, status), expected.FindTopDocuments(query, status)),
+                    query);
+            }
+        }
+        ASSERT(server.GetWordFrequencies(50) == expected.GetWordFrequencies(50));
+        ASSERT(server.GetWordFrequencies(1000) == expected.GetWordFrequencies(1000));
+    }
+
+    for (const string& bad_line : { "x1\tACTUAL\t1\tcat"s, "2\tGOOD\t1\tcat"s, "2\tACTUAL\t1 y\tcat"s, "2\tACTUAL\tcat"s }) {
+        SearchServer server(""s);
+        istringstream input("1\tACTUAL\t1\tdog\n"s + bad_line + "\n"s);
+        try {
+            LoadCorpus(server, input);
+            ASSERT_HINT(false, bad_line);
+        } catch (const invalid_argument& error) {
+            ASSERT_HINT(string(error.what()).find("line 2"s) != string::npos, error.what());
+        }
+    }
+}
+
+void TestIndexFileRoundTrip() {
+    const auto texts = MakeTexts(300);
+    SearchServer original("and in"s);
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        original.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 3), { id % 10, -(id % 4) });
+    }
+    for (int id = 0; id < static_cast<int>(texts.size()); id += 7) {
+        original.RemoveDocument(id);
+    }
+    const string path = (filesystem::temp_directory_path() / "search_server_test_index.bin"s).string();
+    original.Save(path);
+    for (const bool verify : { true, false }) {
+        SearchServer opened = SearchServer::Open(path, verify);
+        ASSERT_EQUAL(opened.GetDocumentCount(), original.GetDocumentCount());
+        ASSERT(vector<int>(opened.begin(), opened.end()) == vector<int>(original.begin(), original.end()));
+        for (const string& query : QUERIES) {
+            for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+                ASSERT_HINT(SameDocuments(original.FindTopDocuments(query, status), opened.FindTopDocuments(query, status)),
+                    query);
+            }
+            ASSERT(original.MatchDocument(query, 11) == opened.MatchDocument(query, 11));
+        }
+        ASSERT(original.GetWordFrequencies(11) == opened.GetWordFrequencies(11));
+        ASSERT(original.GetWordSetFingerprint(11) == opened.GetWordSetFingerprint(11));
+
+        // An opened index can still change, without affecting its copies
+        SearchServer expected = original;
+        const SearchServer copy = opened;
+        for (SearchServer* server : { &opened, &expected }) {
+            server->AddDocument(1000, "cat cat cat zebra"s, DocumentStatus::ACTUAL, { 5 });
+            server->RemoveDocument(1);
+        }
+        ASSERT(SameDocuments(expected.FindTopDocuments("cat zebra"s), opened.FindTopDocuments("cat zebra"s)));
+        ASSERT(vector<int>(opened.begin(), opened.end()) == vector<int>(expected.begin(), expected.end()));
+        ASSERT(SameDocuments(original.FindTopDocuments("cat zebra"s), copy.FindTopDocuments("cat zebra"s)));
+        ASSERT_EQUAL(copy.GetDocumentCount(), original.GetDocumentCount());
+    }
+
+    // Saving over the file an index was opened from leaves it serving
+    {
+        SearchServer opened = SearchServer::Open(path);
+        opened.AddDocument(1000, "cat cat cat zebra"s, DocumentStatus::ACTUAL, { 5 });
+        opened.Save(path);
+        ASSERT(!filesystem::exists(path + ".tmp"s));
+        const SearchServer reopened = SearchServer::Open(path, true);
+        ASSERT_EQUAL(reopened.GetDocumentCount(), original.GetDocumentCount() + 1);
+        for (const string& query : QUERIES) {
+            ASSERT_HINT(SameDocuments(opened.FindTopDocuments(query), reopened.FindTopDocuments(query)), query);
+        }
+        ASSERT(SameDocuments(opened.FindTopDocuments("cat zebra"s), reopened.FindTopDocuments("cat zebra"s)));
+    }
+    filesystem::remove(path);
+}
+
+void TestQueryBatch() {
+    const auto texts = MakeTexts(500);
+    SearchServer server("and in"s);
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 3), { id % 10 });
+    }
+    // Repeats, some only after parsing
+    vector<string> queries;
+    for (int i = 0; i < 40; ++i) {
+        queries.push_back(QUERIES[i % QUERIES.size()]);
+    }
+    queries.push_back("cat and"s);
+    queries.push_back("tail curly -cat"s);
+    queries.push_back("nosuchword"s);
+    vector<vector<Document>> expected;
+    for (const string& query : queries) {
+        expected.push_back(server.FindTopDocuments(query));
+    }
+    const auto same_results = [&expected](const vector<vector<Document>>& results) {
+        return results.size() == expected.size() && equal(results.begin(), results.end(), expected.begin(),
+            [](const vector<Document>& lhs, const vector<Document>& rhs) { return SameDocuments(lhs, rhs); });
+    };
+
+    for (const size_t thread_count : { size_t{ 0 }, size_t{ 1 }, size_t{ 4 } }) {
+        QueryBatch batch(server, thread_count);
+        ASSERT(same_results(batch.Process(queries)));
+        ASSERT_EQUAL(batch.GetStatistics().query_count, queries.size());
+        ASSERT_EQUAL(batch.GetStatistics().distinct_query_count, QUERIES.size() + 1);
+    }
+    ASSERT(same_results(ProcessQueries(server, queries)));
+    ASSERT(ProcessQueries(server, {}).empty());
+
+    // Batches running at once share the worker pool or fall back to their own thread
+    vector<thread> threads;
+    vector<int> matches(4);
+    for (size_t t = 0; t < matches.size(); ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 20; ++i) {
+                matches[t] += same_results(ProcessQueries(server, queries)) ? 1 : 0;
+            }
+        });
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+    ASSERT(all_of(matches.begin(), matches.end(), [](int count) { return count == 20; }));
+
+    try {
+        ProcessQueries(server, { "cat"s, "dog --cat"s });
+        ASSERT_HINT(false, "an invalid query was accepted"s);
+    } catch (const invalid_argument&) {
+    }
+}
+
+void TestProcessQueriesJoined() {
+    const auto texts = MakeTexts(300);
+    SearchServer server("and in"s);
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 3), { id % 10 });
+    }
+    server.AddDocument(1000, "lonely zebra"s, DocumentStatus::ACTUAL, { 1 });
+    // Full tops, short ones and empty ones, with repeats before and after
+    // the queries they repeat
+    const vector<string> queries = { "zebra"s, "cat"s, "nosuchword"s, "zebra lonely"s, "white dog"s, "zebra"s,
+        "curly tail -cat"s, "nosuchword"s, "cat"s, "lonely -zebra"s, "fancy grey bird fish"s, "zebra"s };
+    for (const vector<string>& batch : { queries, vector<string>{}, vector<string>(50, "cat"s) }) {
+        const vector<vector<Document>> expected = ProcessQueries(server, batch);
+        const JoinedDocuments joined = ProcessQueriesJoined(server, batch);
+        ASSERT_EQUAL(joined.GetQueryCount(), batch.size());
+        vector<Document> all_expected;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            const auto documents = joined.GetQueryDocuments(i);
+            ASSERT_HINT(SameDocuments(vector<Document>(documents.begin(), documents.end()), expected[i]), batch[i]);
+            all_expected.insert(all_expected.end(), expected[i].begin(), expected[i].end());
+        }
+        ASSERT(SameDocuments(vector<Document>(joined.begin(), joined.end()), all_expected));
+    }
+}
+
+void TestQueryAllocations() {
+    const auto texts = MakeTexts(500);
+    SearchServer server("and in"s);
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 2), { id % 10 });
+    }
+    vector<Document> result;
+    const auto run_queries = [&]() {
+        int failed_count = 0;
+        for (const string& query : QUERIES) {
+            failed_count += server.TryFindTopDocuments(query, DocumentStatus::ACTUAL, result) != QueryError::NONE;
+            failed_count += server.TryFindTopDocuments(query, [](int document_id, DocumentStatus, int) {
+                return document_id % 3 == 0;
+            }, result) != QueryError::NONE;
+        }
+        return failed_count;
+    };
+    // Grows the buffers of this thread and result to what the queries need
+    ASSERT_EQUAL(run_queries(), 0);
+
+    // Assertions allocate, so they only run once counting is over
+    const size_t allocations_before = GetThreadAllocationCount();
+    const int failed_count = run_queries();
+    const size_t allocations = GetThreadAllocationCount() - allocations_before;
+    ASSERT_EQUAL(failed_count, 0);
+    ASSERT_EQUAL(allocations, 0u);
+}
+
+void TestQueryCacheInvalidation() {
+    const auto texts = MakeTexts(50);
+    SearchServer server(""s);
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, { id % 10 });
+    }
+    QueryCache cache(server);
+    for (const string& query : QUERIES) {
+        ASSERT(SameDocuments(cache.FindTopDocuments(query), server.FindTopDocuments(query)));
+    }
+    ASSERT_EQUAL(cache.GetHitCount(), 0u);
+    ASSERT(SameDocuments(cache.FindTopDocuments(QUERIES[0]), server.FindTopDocuments(QUERIES[0])));
+    ASSERT_EQUAL(cache.GetHitCount(), 1u);
+
+    // Adding and removing documents must not leave stale results behind
+    server.AddDocument(100, "cat cat cat"s, DocumentStatus::ACTUAL, { 9 });
+    auto found_docs = cache.FindTopDocuments("cat"s);
+    ASSERT(SameDocuments(found_docs, server.FindTopDocuments("cat"s)));
+    ASSERT_EQUAL(found_docs.front().id, 100);
+    server.RemoveDocument(100);
+    found_docs = cache.FindTopDocuments("cat"s);
+    ASSERT(SameDocuments(found_docs, server.FindTopDocuments("cat"s)));
+    ASSERT(none_of(found_docs.begin(), found_docs.end(), [](const Document& document) { return document.id == 100; }));
+}
+
+void TestSegmentMerge() {
+    const auto texts = MakeTexts(200);
+    SearchServer expected(""s);
+    // A small buffer, so that the documents end up in many segments that get merged
+    SegmentedSearchServer segmented(""s, 8);
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        expected.AddDocument(id, texts[id], DocumentStatus::ACTUAL, { id % 10 });
+        segmented.AddDocument(id, texts[id], DocumentStatus::ACTUAL, { id % 10 });
+    }
+    segmented.Flush();
+    segmented.WaitForMerges();
+    ASSERT_EQUAL(segmented.GetDocumentCount(), expected.GetDocumentCount());
+    ASSERT(segmented.GetSegmentCount() < texts.size() / 8);
+    for (const string& query : QUERIES) {
+        ASSERT_HINT(SameDocuments(expected.FindTopDocuments(query), segmented.FindTopDocuments(query), EPSILON), query);
+    }
+
+    // Removed documents disappear at once and stay away after merging
+    for (int id = 0; id < static_cast<int>(texts.size()); id += 3) {
+        expected.RemoveDocument(id);
+        segmented.RemoveDocument(id);
+    }
+    // Hidden documents don't count towards word scores either
+    const auto check_removed = [&] {
+        ASSERT_EQUAL(segmented.GetDocumentCount(), expected.GetDocumentCount());
+        for (const string& query : QUERIES) {
+            for (const Document& document : segmented.FindTopDocuments(query, DocumentStatus::ACTUAL, texts.size())) {
+                ASSERT_HINT(document.id % 3 != 0, query);
+            }
+            ASSERT_HINT(SameDocuments(expected.FindTopDocuments(query), segmented.FindTopDocuments(query), EPSILON), query);
+        }
+    };
+    check_removed();
+    segmented.Flush();
+    segmented.WaitForMerges();
+    check_removed();
+}
+
+void TestSegmentedPendingBatch() {
+    const auto texts = MakeTexts(2500);
+    SearchServer expected(""s);
+    SegmentedSearchServer segmented(""s);
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        expected.AddDocument(id, texts[id], DocumentStatus::ACTUAL, { id % 10 });
+        // The buffer keeps its own copy of a text until the batch is indexed
+        string text = texts[id];
+        segmented.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 10 });
+        text.assign(text.size(), 'x');
+        // Queries see every document added before them, batched or not
+        if (id % 500 == 0 || id == 1500) {
+            for (const string& query : QUERIES) {
+                ASSERT_HINT(SameDocuments(expected.FindTopDocuments(query), segmented.FindTopDocuments(query), EPSILON), query);
+            }
+        }
+    }
+
+    // Errors are still reported by AddDocument itself
+    for (const auto& [id, text] : vector<pair<int, string>>{ { 2499, "cat"s }, { 3000, "cat do\x12g"s }, { -1, "cat"s } }) {
+        try {
+            segmented.AddDocument(id, text, DocumentStatus::ACTUAL, {});
+            ASSERT_HINT(false, "an invalid document was accepted"s);
+        } catch (const invalid_argument&) {
+        }
+    }
+    for (const int id : { 2499, 1200, 7 }) {
+        expected.RemoveDocument(id);
+        segmented.RemoveDocument(id);
+    }
+    ASSERT_EQUAL(segmented.GetDocumentCount(), expected.GetDocumentCount());
+    for (const string& query : QUERIES) {
+        ASSERT_HINT(SameDocuments(expected.FindTopDocuments(query, DocumentStatus::ACTUAL, texts.size()),
+            segmented.FindTopDocuments(query, DocumentStatus::ACTUAL, texts.size()), EPSILON), query);
+    }
+}
+
+void TestShardedIdf() {
+    const auto texts = MakeTexts(300);
+    vector<NewDocument> documents;
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        documents.push_back({ id, texts[id], id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id % 10 } });
+    }
+    SearchServer expected(""s);
+    expected.AddDocuments(documents);
+    ShardedSearchServer sharded(""sv, 3);
+    sharded.AddDocuments(documents);
+    // Removals leave the shards with different document counts
+    for (int id = 0; id < 100; id += 2) {
+        expected.RemoveDocument(id);
+        sharded.RemoveDocument(id);
+    }
+    ASSERT_EQUAL(sharded.GetDocumentCount(), expected.GetDocumentCount());
+    for (const string& query : QUERIES) {
+        for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+            ASSERT_HINT(SameDocuments(expected.FindTopDocuments(query, status), sharded.FindTopDocuments(query, status)),
+                "Scores must use the document frequencies of the whole collection: "s + query);
+        }
+    }
+}
+
+void TestDuplicates() {
+    SearchServer server(""s);
+    server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+    // Same words as 2 in another order and count
+    server.AddDocument(3, "curly hair with funny pet pet"s, DocumentStatus::ACTUAL, { 1, 2 });
+    server.AddDocument(4, "funny pet and curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+    server.AddDocument(5, "nasty rat and funny pet"s, DocumentStatus::ACTUAL, { 1, 2 });
+    ASSERT(FindDuplicates(server) == vector<int>({ 3, 5 }));
+    ASSERT(RemoveDuplicates(server) == vector<int>({ 3, 5 }));
+    ASSERT_EQUAL(server.GetDocumentCount(), 3);
+    ASSERT(FindDuplicates(server).empty());
+}
+
+void TestNearDuplicates() {
+    string text;
+    for (int i = 0; i < 40; ++i) {
+        text += "word"s + to_string(i) + " "s;
+    }
+    SearchServer server(""s);
+    server.AddDocument(1, text, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, text + "extra"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(3, "completely different words here"s, DocumentStatus::ACTUAL, { 1 });
+    NearDuplicateDetector detector(server);
+    ASSERT_EQUAL(detector.GetDocumentCount(), 3u);
+    ASSERT(detector.FindClusters() == vector<vector<int>>({ { 1, 2 } }));
+
+    // The detector picks up changes to the server by itself
+    server.AddDocument(4, text + "other"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT(detector.FindClusters() == vector<vector<int>>({ { 1, 2, 4 } }));
+    server.RemoveDocument(1);
+    ASSERT(detector.FindClusters() == vector<vector<int>>({ { 2, 4 } }));
+    server.AddDocument(1, "completely different words here here"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT(detector.FindClusters() == vector<vector<int>>({ { 1, 3 }, { 2, 4 } }));
+    ASSERT_EQUAL(detector.GetDocumentCount(), 4u);
+
+    // A cap on bucket comparisons is reported, and 0 lifts it
+    for (int id = 5; id < 10; ++id) {
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, { 1 });
+    }
+    size_t skipped_comparison_count = 0;
+    NearDuplicateOptions options;
+    options.max_bucket_comparisons = 1;
+    ASSERT(NearDuplicateDetector(server, options).FindClusters(skipped_comparison_count)
+        == vector<vector<int>>({ { 1, 3 }, { 2, 4, 5, 6, 7, 8, 9 } }));
+    ASSERT(skipped_comparison_count > 0);
+    options.max_bucket_comparisons = 0;
+    NearDuplicateDetector(server, options).FindClusters(skipped_comparison_count);
+    ASSERT_EQUAL(skipped_comparison_count, 0u);
+}
+
+void TestConcurrentSnapshots() {
+    ConcurrentSearchServer server(""s);
+    server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "black cat"s, DocumentStatus::ACTUAL, { 2 });
+    thread writer;
+    {
+        const auto snapshot = server.GetSnapshot();
+        // The writer publishes its first change, then waits for this reader
+        writer = thread([&server] {
+            server.RemoveDocument(1);
+            server.AddDocument(3, "grey cat"s, DocumentStatus::ACTUAL, { 3 });
+        });
+        while (server.FindTopDocuments("white"s).size() == 1) {
+            this_thread::yield();
+        }
+        // A snapshot keeps answering from the index it was taken of
+        ASSERT_EQUAL(snapshot->GetDocumentCount(), 2);
+        ASSERT_EQUAL(snapshot->FindTopDocuments("white"s).size(), 1u);
+        ASSERT_EQUAL(get<0>(snapshot->MatchDocument("white cat"s, 1)).size(), 2u);
+    }
+    writer.join();
+    ASSERT_EQUAL(server.GetDocumentCount(), 2);
+    ASSERT(server.FindTopDocuments("white"s).empty());
+    ASSERT_EQUAL(server.FindTopDocuments("grey"s).size(), 1u);
+
+    // A rejected change is published nowhere, and matched words outlive
+    // later changes
+    const auto [words, status] = server.MatchDocument("grey"s, 3);
+    bool thrown = false;
+    try {
+        server.AddDocument(3, "red cat"s, DocumentStatus::ACTUAL, { 1 });
+    }
+    catch (const invalid_argument&) {
+        thrown = true;
+    }
+    ASSERT(thrown);
+    for (int id = 10; id < 20; ++id) {
+        server.AddDocument(id, "red cat"s, DocumentStatus::ACTUAL, { 1 });
+        server.RemoveDocument(id - 1);
+    }
+    ASSERT(server.FindTopDocuments("red"s, DocumentStatus::ACTUAL, 100).size() == 1u);
+    ASSERT(words == vector<string_view>({ "grey"sv }));
+    ASSERT(status == DocumentStatus::ACTUAL);
+}
+
+void TestSearchServer() {
+    RUN_TEST(TestExcludeStopWordsFromAddedDocumentContent);
+    RUN_TEST(TestMinusWordsAndStatuses);
+    RUN_TEST(TestWordFrequencies);
+    RUN_TEST(TestTopCountAndTieBreak);
+    RUN_TEST(TestShardedScoring);
+    RUN_TEST(TestSplitIntoWords);
+    RUN_TEST(TestPostingCursors);
+    RUN_TEST(TestCorruptedPostings);
+    RUN_TEST(TestFindTopDocumentsWithAllWords);
+    RUN_TEST(TestConcurrentMap);
+    RUN_TEST(TestAddDocuments);
+    RUN_TEST(TestIndexFileRoundTrip);
+    RUN_TEST(TestLoadCorpus);
+    RUN_TEST(TestQueryAllocations);
+    RUN_TEST(TestQueryBatch);
+    RUN_TEST(TestProcessQueriesJoined);
+    RUN_TEST(TestQueryCacheInvalidation);
+    RUN_TEST(TestSegmentMerge);
+    RUN_TEST(TestSegmentedPendingBatch);
+    RUN_TEST(TestShardedIdf);
+    RUN_TEST(TestDuplicates);
+    RUN_TEST(TestNearDuplicates);
+    RUN_TEST(TestConcurrentSnapshots);
+}
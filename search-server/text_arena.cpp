@@ -0,0 +1,29 @@
+#include "text_arena.h"
+
+#include <algorithm>
+#include <cstring>
+
+std::string_view TextArena::Append(const std::string_view text) {
+    if (text.empty()) {
+        return {};
+    }
+    if (chunks_.empty() || chunks_.back().capacity - chunks_.back().size < text.size()) {
+        const size_t capacity = std::max(CHUNK_SIZE, text.size());
+        chunks_.push_back({ std::make_unique<char[]>(capacity), capacity, 0 });
+        allocated_bytes_ += capacity;
+    }
+    Chunk& chunk = chunks_.back();
+    char* const dest = chunk.data.get() + chunk.size;
+    std::memcpy(dest, text.data(), text.size());
+    chunk.size += text.size();
+    used_bytes_ += text.size();
+    return { dest, text.size() };
+}
+
+size_t TextArena::GetUsedBytes() const {
+    return used_bytes_;
+}
+
+size_t TextArena::GetAllocatedBytes() const {
+    return allocated_bytes_;
+}
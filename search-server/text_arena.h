@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Append-only text storage. Chunks are never reallocated, so every view
+// returned by Append stays valid until the arena itself is destroyed.
+class TextArena {
+public:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    TextArena() = default;
+
+    TextArena(const TextArena&) = delete;
+    TextArena& operator=(const TextArena&) = delete;
+
+    TextArena(TextArena&&) = default;
+    TextArena& operator=(TextArena&&) = default;
+
+    std::string_view Append(const std::string_view text);
+
+    size_t GetUsedBytes() const;
+
+    size_t GetAllocatedBytes() const;
+
+private:
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        size_t capacity = 0;
+        size_t size = 0;
+    };
+
+    std::vector<Chunk> chunks_;
+    size_t used_bytes_ = 0;
+    size_t allocated_bytes_ = 0;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "document.h"
+
+constexpr double EPSILON = 1e-6;
+
+// Relevance first; relevances closer than EPSILON are ordered by rating.
+// Full ties go to the smaller id, so the result doesn't depend on the
+// order in which documents were scored.
+inline bool HasHigherRank(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
+        if (lhs.rating == rhs.rating) {
+            return lhs.id < rhs.id;
+        }
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+// Keeps the best `capacity` documents seen so far in a heap whose top is
+// the worst of them, so every Push costs O(log capacity).
+class TopDocuments {
+public:
+    explicit TopDocuments(size_t capacity)
+        : capacity_(capacity)
+    {
+        heap_.reserve(capacity);
+    }
+
+    void Push(const Document& document) {
+        if (heap_.size() < capacity_) {
+            heap_.push_back(document);
+            std::push_heap(heap_.begin(), heap_.end(), HasHigherRank);
+        }
+        else if (capacity_ > 0 && HasHigherRank(document, heap_.front())) {
+            std::pop_heap(heap_.begin(), heap_.end(), HasHigherRank);
+            heap_.back() = document;
+            std::push_heap(heap_.begin(), heap_.end(), HasHigherRank);
+        }
+    }
+
+    // Empties the heap, keeping its storage
+    void Reset(size_t capacity) {
+        capacity_ = capacity;
+        heap_.clear();
+        heap_.reserve(capacity);
+    }
+
+    bool IsFull() const {
+        return heap_.size() == capacity_;
+    }
+
+    // The document that the next Push has to outrank
+    const Document& GetWorst() const {
+        return heap_.front();
+    }
+
+    void Merge(const TopDocuments& other) {
+        for (const Document& document : other.heap_) {
+            Push(document);
+        }
+    }
+
+    // Best first
+    std::vector<Document> Extract() {
+        std::sort_heap(heap_.begin(), heap_.end(), HasHigherRank);
+        return std::move(heap_);
+    }
+
+    // Best first, into result, leaving the heap empty but with its storage
+    void Extract(std::vector<Document>& result) {
+        std::sort_heap(heap_.begin(), heap_.end(), HasHigherRank);
+        result.assign(heap_.begin(), heap_.end());
+        heap_.clear();
+    }
+
+    // Same, into output, which has room for capacity documents; returns
+    // how many there were
+    size_t Extract(Document* output) {
+        std::sort_heap(heap_.begin(), heap_.end(), HasHigherRank);
+        std::copy(heap_.begin(), heap_.end(), output);
+        const size_t count = heap_.size();
+        heap_.clear();
+        return count;
+    }
+
+private:
+    size_t capacity_;
+    std::vector<Document> heap_;
+};
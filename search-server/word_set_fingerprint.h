@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 128-bit hash of the set of words of a document, equal for documents with
+// the same words whatever their order and counts. With 128 bits, telling
+// documents apart by fingerprint alone is safe for any realistic corpus.
+struct WordSetFingerprint {
+    uint64_t low = 0;
+    uint64_t high = 0;
+};
+
+inline bool operator==(const WordSetFingerprint& lhs, const WordSetFingerprint& rhs) {
+    return lhs.low == rhs.low && lhs.high == rhs.high;
+}
+
+inline bool operator!=(const WordSetFingerprint& lhs, const WordSetFingerprint& rhs) {
+    return !(lhs == rhs);
+}
+
+struct WordSetFingerprintHash {
+    size_t operator()(const WordSetFingerprint& fingerprint) const {
+        // Both halves are already well mixed
+        return static_cast<size_t>(fingerprint.low);
+    }
+};
+
+// Builds a fingerprint from word ids added in ascending order
+class WordSetFingerprintBuilder {
+public:
+    void Add(uint32_t word_id) {
+        const uint64_t key = Mix(word_id + 1);
+        low_ = Mix(low_ ^ key);
+        high_ = Mix(high_ + key * 0x87C37B91114253D5ULL);
+        ++count_;
+    }
+
+    WordSetFingerprint Get() const {
+        return { Mix(low_ ^ count_), Mix(high_ + count_) };
+    }
+
+private:
+    uint64_t low_ = 0x9E3779B97F4A7C15ULL;
+    uint64_t high_ = 0xC2B2AE3D27D4EB4FULL;
+    uint64_t count_ = 0;
+
+    // The splitmix64 finalizer
+    static uint64_t Mix(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+};